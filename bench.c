@@ -0,0 +1,928 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include "json.h"
+#ifndef JSON_IO_STATIC
+#include "json_io.h"
+#include "json_z.h"
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Synthetic workloads run against each backend.  Results are written as
+ * JSON to stdout so they can be diffed between releases. */
+
+#define BENCH_POINTS  200000
+#define BENCH_STRINGS 50000
+#define BENCH_STR_MAX 64
+#define BENCH_NUMBERS 200000
+#define BENCH_DEPTH   256
+#define BENCH_TREES   200
+#define BENCH_BLOB    (4 << 20)
+#define BENCH_REPEAT  5
+#define BENCH_BUF     (64 << 20)
+#define BENCH_ASYNC   (4 << 20)
+
+struct point
+{
+	int32_t x;
+	int32_t y;
+};
+
+struct data
+{
+	struct point *points;
+	char (*strings)[BENCH_STR_MAX + 1];
+	double *doubles;
+	double *walk; /* a polyline coordinate in millimetres */
+	int64_t *ints;
+	uint8_t *blob;
+};
+
+struct corpus
+{
+	const char *name;
+	const char *family;
+	size_t values;
+	bool(*write)(json_t *json, const struct data *data);
+	bool(*read)(json_t *json, struct data *data);
+	/* compares what was read back with the generated data */
+	bool(*same)(const struct data *data, const struct data *back);
+};
+
+#define CHECK(expr) do { if (!(expr)) return false; } while (0)
+
+static
+bool points_write(json_t *json, const struct data *data)
+{
+	json_obj_t root, list, elem;
+	CHECK(json_write_object_begin(json, "root", &root));
+	CHECK(json_write_uint64(json, "n", BENCH_POINTS));
+	CHECK(json_write_array_begin(json, "points", &list));
+	for (size_t i = 0; i < BENCH_POINTS; ++i) {
+		CHECK(json_write_object_begin(json, "point", &elem));
+		CHECK(json_write_int32(json, "x", data->points[i].x));
+		CHECK(json_write_int32(json, "y", data->points[i].y));
+		CHECK(json_write_object_end(json));
+	}
+	CHECK(json_write_array_end(json));
+	return json_write_object_end(json);
+}
+
+static
+bool points_read(json_t *json, struct data *data)
+{
+	json_obj_t root, list, elem;
+	uint64_t n;
+	CHECK(json_read_object_begin(json, "root", &root));
+	CHECK(json_read_uint64(json, "n", &n) && n == BENCH_POINTS);
+	CHECK(json_read_array_begin(json, "points", &list));
+	for (size_t i = 0; i < n; ++i) {
+		CHECK(json_read_object_begin(json, "point", &elem));
+		CHECK(json_read_int32(json, "x", &data->points[i].x));
+		CHECK(json_read_int32(json, "y", &data->points[i].y));
+		CHECK(json_read_object_end(json));
+	}
+	CHECK(json_read_array_end(json));
+	return json_read_object_end(json);
+}
+
+/* The same document read through the out-of-order path. */
+static
+bool point_x(json_t *json, const char *label, void *user)
+{
+	return json_read_int32(json, label, &((struct point *)user)->x);
+}
+
+static
+bool point_y(json_t *json, const char *label, void *user)
+{
+	return json_read_int32(json, label, &((struct point *)user)->y);
+}
+
+static const json_member_t g_point_members[] = {
+	{ "x", point_x },
+	{ "y", point_y },
+};
+
+static
+bool tolerant_read(json_t *json, struct data *data)
+{
+	json_obj_t root, list;
+	json_labels_t labels;
+	uint64_t n;
+	CHECK(json_labels_init(&labels, g_point_members, 2));
+	CHECK(json_read_object_begin(json, "root", &root));
+	CHECK(json_read_uint64(json, "n", &n) && n == BENCH_POINTS);
+	CHECK(json_read_array_begin(json, "points", &list));
+	for (size_t i = 0; i < n; ++i)
+		CHECK(json_read_members(json, "point", &labels, &data->points[i], NULL));
+	CHECK(json_read_array_end(json));
+	return json_read_object_end(json);
+}
+
+static const json_column_t g_point_columns[] = {
+	JSON_COLUMN(struct point, x, INT32),
+	JSON_COLUMN(struct point, y, INT32),
+};
+
+static
+bool columns_write(json_t *json, const struct data *data)
+{
+	return json_write_columns(json, "points", data->points, BENCH_POINTS, sizeof(struct point),
+	                          g_point_columns, 2);
+}
+
+static
+bool columns_read(json_t *json, struct data *data)
+{
+	size_t n;
+	return json_read_columns(json, "points", data->points, BENCH_POINTS, &n, sizeof(struct point),
+	                         g_point_columns, 2)
+	    && n == BENCH_POINTS;
+}
+
+/* The points document again, through the shape-cached record path. */
+static
+bool records_write(json_t *json, const struct data *data)
+{
+	json_obj_t root;
+	return json_write_object_begin(json, "root", &root)
+	    && json_write_uint64(json, "n", BENCH_POINTS)
+	    && json_write_records(json, "points", data->points, BENCH_POINTS, sizeof(struct point),
+	                          g_point_columns, 2)
+	    && json_write_object_end(json);
+}
+
+static
+bool records_read(json_t *json, struct data *data)
+{
+	json_obj_t root;
+	uint64_t n;
+	size_t len;
+	CHECK(json_read_object_begin(json, "root", &root));
+	CHECK(json_read_uint64(json, "n", &n) && n == BENCH_POINTS);
+	CHECK(json_read_records(json, "points", data->points, BENCH_POINTS, &len, sizeof(struct point),
+	                        g_point_columns, 2) && len == BENCH_POINTS);
+	return json_read_object_end(json);
+}
+
+static
+bool strings_write(json_t *json, const struct data *data)
+{
+	json_obj_t list;
+	CHECK(json_write_array_begin(json, "strings", &list));
+	for (size_t i = 0; i < BENCH_STRINGS; ++i)
+		CHECK(json_write_str(json, "s", data->strings[i]));
+	return json_write_array_end(json);
+}
+
+static
+bool strings_read(json_t *json, struct data *data)
+{
+	json_obj_t list;
+	CHECK(json_read_array_begin(json, "strings", &list));
+	for (size_t i = 0; i < BENCH_STRINGS; ++i)
+		CHECK(json_read_str(json, "s", data->strings[i], BENCH_STR_MAX + 1));
+	return json_read_array_end(json);
+}
+
+static
+bool doubles_write(json_t *json, const struct data *data)
+{
+	json_obj_t list;
+	CHECK(json_write_array_begin(json, "doubles", &list));
+	for (size_t i = 0; i < BENCH_NUMBERS; ++i)
+		CHECK(json_write_double(json, "d", data->doubles[i]));
+	return json_write_array_end(json);
+}
+
+static
+bool doubles_read(json_t *json, struct data *data)
+{
+	json_obj_t list;
+	CHECK(json_read_array_begin(json, "doubles", &list));
+	for (size_t i = 0; i < BENCH_NUMBERS; ++i)
+		CHECK(json_read_double(json, "d", &data->doubles[i]));
+	return json_read_array_end(json);
+}
+
+/* The same values quantized to micrometres, as most stored coordinates are. */
+static
+bool fixed_write(json_t *json, const struct data *data)
+{
+	json_obj_t list;
+	CHECK(json_write_array_begin(json, "doubles", &list));
+	for (size_t i = 0; i < BENCH_NUMBERS; ++i)
+		CHECK(json_write_double_prec(json, "d", data->doubles[i], JSON_PRECISION_DECIMALS, 3));
+	return json_write_array_end(json);
+}
+
+static
+bool walk_write(json_t *json, const struct data *data)
+{
+	json_obj_t list;
+	CHECK(json_write_array_begin(json, "walk", &list));
+	for (size_t i = 0; i < BENCH_NUMBERS; ++i)
+		CHECK(json_write_double_prec(json, "d", data->walk[i], JSON_PRECISION_DECIMALS, 3));
+	return json_write_array_end(json);
+}
+
+static
+bool walk_read(json_t *json, struct data *data)
+{
+	json_obj_t list;
+	CHECK(json_read_array_begin(json, "walk", &list));
+	for (size_t i = 0; i < BENCH_NUMBERS; ++i)
+		CHECK(json_read_double(json, "d", &data->walk[i]));
+	return json_read_array_end(json);
+}
+
+static
+bool delta_write(json_t *json, const struct data *data)
+{
+	return json_write_delta_array(json, "walk", data->walk, BENCH_NUMBERS, sizeof(double),
+	                              data->walk[0], 1e-3);
+}
+
+static
+bool delta_read(json_t *json, struct data *data)
+{
+	size_t n;
+	return json_read_delta_array(json, "walk", data->walk, BENCH_NUMBERS, &n, sizeof(double))
+	    && n == BENCH_NUMBERS;
+}
+
+static
+bool ints_write(json_t *json, const struct data *data)
+{
+	json_obj_t list;
+	CHECK(json_write_array_begin(json, "ints", &list));
+	for (size_t i = 0; i < BENCH_NUMBERS; ++i)
+		CHECK(json_write_int64(json, "i", data->ints[i]));
+	return json_write_array_end(json);
+}
+
+static
+bool ints_read(json_t *json, struct data *data)
+{
+	json_obj_t list;
+	CHECK(json_read_array_begin(json, "ints", &list));
+	for (size_t i = 0; i < BENCH_NUMBERS; ++i)
+		CHECK(json_read_int64(json, "i", &data->ints[i]));
+	return json_read_array_end(json);
+}
+
+static
+bool nesting_write(json_t *json, const struct data *data)
+{
+	json_obj_t list, objs[BENCH_DEPTH];
+	CHECK(json_write_array_begin(json, "trees", &list));
+	for (size_t t = 0; t < BENCH_TREES; ++t) {
+		for (size_t d = 0; d < BENCH_DEPTH; ++d) {
+			CHECK(json_write_object_begin(json, "c", &objs[d]));
+			CHECK(json_write_uint32(json, "d", (uint32_t)d));
+		}
+		for (size_t d = 0; d < BENCH_DEPTH; ++d)
+			CHECK(json_write_object_end(json));
+	}
+	return json_write_array_end(json);
+}
+
+static
+bool nesting_read(json_t *json, struct data *data)
+{
+	json_obj_t list, objs[BENCH_DEPTH];
+	uint32_t val;
+	CHECK(json_read_array_begin(json, "trees", &list));
+	for (size_t t = 0; t < BENCH_TREES; ++t) {
+		for (size_t d = 0; d < BENCH_DEPTH; ++d) {
+			CHECK(json_read_object_begin(json, "c", &objs[d]));
+			CHECK(json_read_uint32(json, "d", &val) && val == d);
+		}
+		for (size_t d = 0; d < BENCH_DEPTH; ++d)
+			CHECK(json_read_object_end(json));
+	}
+	return json_read_array_end(json);
+}
+
+static
+bool blob_write(json_t *json, const struct data *data)
+{
+	return json_write_blob(json, "blob", data->blob, BENCH_BLOB);
+}
+
+static
+bool blob_read(json_t *json, struct data *data)
+{
+	size_t len;
+	return json_read_blob(json, "blob", data->blob, BENCH_BLOB, &len)
+	    && len == BENCH_BLOB;
+}
+
+/* read-back checks */
+
+static
+bool points_same(const struct data *data, const struct data *back)
+{
+	return memcmp(data->points, back->points, BENCH_POINTS * sizeof(*data->points)) == 0;
+}
+
+static
+bool strings_same(const struct data *data, const struct data *back)
+{
+	for (size_t i = 0; i < BENCH_STRINGS; ++i)
+		CHECK(strcmp(data->strings[i], back->strings[i]) == 0);
+	return true;
+}
+
+static
+bool doubles_same(const struct data *data, const struct data *back)
+{
+	for (size_t i = 0; i < BENCH_NUMBERS; ++i)
+		CHECK(data->doubles[i] == back->doubles[i]);
+	return true;
+}
+
+/* Within half a step of the 3 decimals, plus rounding. */
+static
+bool near_milli(double a, double b)
+{
+	return a - b > -5.01e-4 && a - b < 5.01e-4;
+}
+
+static
+bool fixed_same(const struct data *data, const struct data *back)
+{
+	for (size_t i = 0; i < BENCH_NUMBERS; ++i)
+		CHECK(near_milli(data->doubles[i], back->doubles[i]));
+	return true;
+}
+
+/* walk & delta, both at 1e-3 */
+static
+bool walk_same(const struct data *data, const struct data *back)
+{
+	for (size_t i = 0; i < BENCH_NUMBERS; ++i)
+		CHECK(near_milli(data->walk[i], back->walk[i]));
+	return true;
+}
+
+static
+bool ints_same(const struct data *data, const struct data *back)
+{
+	return memcmp(data->ints, back->ints, BENCH_NUMBERS * sizeof(*data->ints)) == 0;
+}
+
+/* nesting_read compares each value as it goes */
+static
+bool nesting_same(const struct data *data, const struct data *back)
+{
+	(void)data;
+	(void)back;
+	return true;
+}
+
+static
+bool blob_same(const struct data *data, const struct data *back)
+{
+	return memcmp(data->blob, back->blob, BENCH_BLOB) == 0;
+}
+
+static const struct corpus g_corpora[] = {
+	{ "points",  "object/int32",  BENCH_POINTS * 3,              points_write,  points_read,   points_same  },
+	{ "tolerant", "object/int32", BENCH_POINTS * 3,              points_write,  tolerant_read, points_same  },
+	{ "records", "object/int32",  BENCH_POINTS * 3,              records_write, records_read,  points_same  },
+	{ "columns", "columns/int32", BENCH_POINTS * 2,              columns_write, columns_read,  points_same  },
+	{ "strings", "str",           BENCH_STRINGS,                 strings_write, strings_read,  strings_same },
+	{ "doubles", "double",        BENCH_NUMBERS,                 doubles_write, doubles_read,  doubles_same },
+	{ "fixed",   "double/fixed",  BENCH_NUMBERS,                 fixed_write,   doubles_read,  fixed_same   },
+	{ "walk",    "double/fixed",  BENCH_NUMBERS,                 walk_write,    walk_read,     walk_same    },
+	{ "delta",   "delta",         BENCH_NUMBERS,                 delta_write,   delta_read,    walk_same    },
+	{ "ints",    "int64",         BENCH_NUMBERS,                 ints_write,    ints_read,     ints_same    },
+	{ "nesting", "object/uint32", BENCH_TREES * BENCH_DEPTH * 2, nesting_write, nesting_read,  nesting_same },
+	{ "blob",    "blob",          BENCH_BLOB,                    blob_write,    blob_read,     blob_same    },
+};
+
+/* A user-supplied callback backend, to measure the cost of going through
+ * functions outside the library. */
+
+struct sink
+{
+	char *buf;
+	size_t pos, len;
+};
+
+static
+int sink_fgetc(void *user)
+{
+	struct sink *s = user;
+	return s->pos < s->len ? (unsigned char)s->buf[s->pos++] : EOF;
+}
+
+static
+int sink_ungetc(int c, void *user)
+{
+	struct sink *s = user;
+	return c != EOF && s->pos > 0 ? (s->pos--, c) : EOF;
+}
+
+static
+size_t sink_fread(void *ptr, size_t size, size_t nmemb, void *user)
+{
+	struct sink *s = user;
+	size_t n = size * nmemb;
+	if (n > s->len - s->pos)
+		n = s->len - s->pos;
+	memcpy(ptr, &s->buf[s->pos], n);
+	s->pos += n;
+	return n / size;
+}
+
+static
+size_t sink_fwrite(const void *ptr, size_t size, size_t nmemb, void *user)
+{
+	struct sink *s = user;
+	size_t n = size * nmemb;
+	if (n > s->len - s->pos)
+		n = s->len - s->pos;
+	memcpy(&s->buf[s->pos], ptr, n);
+	s->pos += n;
+	return n / size;
+}
+
+static
+int sink_fputc(int c, void *user)
+{
+	struct sink *s = user;
+	return s->pos < s->len ? (unsigned char)(s->buf[s->pos++] = (char)c) : EOF;
+}
+
+static const json_io_t g_sink_io = {
+	.fgetc  = sink_fgetc,
+	.ungetc = sink_ungetc,
+	.fread  = sink_fread,
+	.fwrite = sink_fwrite,
+	.fputc  = sink_fputc,
+};
+
+/* backends */
+
+enum backend
+{
+	BACKEND_MEM,
+	BACKEND_FILE,
+	BACKEND_CALLBACK,
+	BACKEND_DIGEST,   /* memory behind json_init_digest: the cost of the crc */
+	BACKEND_ASYNC,    /* written through json_io.c, read back as a file */
+	BACKEND_MMAP,
+	/* from here on, readers also need json_finish */
+	BACKEND_PREFETCH, /* written as a file, read back through a reader thread */
+	BACKEND_GZIP,     /* a file through json_z.c, at the fastest level */
+#if JSON_ZSTD
+	BACKEND_ZSTD,     /* the same at zstd's default level */
+#endif
+	BACKEND_COUNT,
+};
+
+static const char *g_backend_names[BACKEND_COUNT] = { "mem", "file", "callback", "digest", "async",
+                                                  "mmap", "prefetch", "gzip",
+#if JSON_ZSTD
+                                                  "zstd",
+#endif
+};
+
+/* Backends starting a thread of their own.  On glibc the first thread puts
+ * all stdio into locked mode for good, so these run after everything else
+ * to keep the "file" rows comparable between releases. */
+static
+bool backend_threaded(enum backend b)
+{
+	return b == BACKEND_ASYNC || b == BACKEND_PREFETCH;
+}
+
+/* Backends covering one direction use plain json_init_file for the other,
+ * which still checks the round trip but would only repeat the "file" row. */
+static
+bool backend_reports(enum backend b, bool write)
+{
+	return write ? b != BACKEND_PREFETCH : b != BACKEND_ASYNC && b != BACKEND_MMAP;
+}
+
+/* A single translation unit build with JSON_IO_STATIC=JSON_IO_MEM can only
+ * talk to memory, which is also what makes it comparable to the default. */
+#ifdef JSON_IO_STATIC
+#define BENCH_BACKENDS 1
+#define BENCH_BUILD "static"
+#else
+#define BENCH_BACKENDS BACKEND_COUNT
+#define BENCH_BUILD "separate"
+#endif
+
+struct stream
+{
+	enum backend backend;
+	char *buf;
+	size_t len; /* bytes produced by the last write */
+	json_mem_t mem;
+	struct sink sink;
+	json_digest_t digest;
+	FILE *fp;
+#ifndef JSON_IO_STATIC
+	json_async_t async;
+	json_mmap_t map;
+	json_prefetch_t prefetch;
+	json_zfile_t zfile;
+#endif
+};
+
+static
+void stream_open(struct stream *s, json_t *json, bool write)
+{
+	switch (s->backend) {
+	case BACKEND_MEM:
+		s->mem = (json_mem_t){ .buf = s->buf, .len = write ? BENCH_BUF : s->len };
+		json_init_mem(json, &s->mem);
+		break;
+	case BACKEND_FILE:
+		if (write) {
+			if (s->fp)
+				fclose(s->fp);
+			s->fp = tmpfile();
+		} else {
+			rewind(s->fp);
+		}
+		json_init_file(json, s->fp);
+		break;
+	case BACKEND_CALLBACK:
+		s->sink = (struct sink){ .buf = s->buf, .len = write ? BENCH_BUF : s->len };
+		json_init(json, g_sink_io, &s->sink);
+		break;
+	case BACKEND_DIGEST:
+		s->mem = (json_mem_t){ .buf = s->buf, .len = write ? BENCH_BUF : s->len };
+		json_init_digest(json, &s->digest, g_json_io_mem, &s->mem);
+		break;
+#ifndef JSON_IO_STATIC
+	case BACKEND_ASYNC:
+		if (write) {
+			static char buf[BENCH_ASYNC];
+			if (s->fp)
+				fclose(s->fp);
+			s->fp = tmpfile();
+			if (!json_init_async(json, &s->async, fileno(s->fp), buf, sizeof(buf)))
+				abort();
+		} else {
+			rewind(s->fp);
+			json_init_file(json, s->fp);
+		}
+		break;
+	case BACKEND_MMAP:
+		if (write) {
+			if (s->fp)
+				fclose(s->fp);
+			s->fp = tmpfile();
+			if (!json_init_mmap(json, &s->map, fileno(s->fp), 0))
+				abort();
+		} else {
+			rewind(s->fp);
+			json_init_file(json, s->fp);
+		}
+		break;
+	case BACKEND_PREFETCH:
+		if (write) {
+			if (s->fp)
+				fclose(s->fp);
+			s->fp = tmpfile();
+			json_init_file(json, s->fp);
+		} else {
+			static char buf[BENCH_ASYNC];
+			rewind(s->fp);
+			if (!json_init_prefetch(json, &s->prefetch, g_json_io_file, s->fp, buf, sizeof(buf)))
+				abort();
+		}
+		break;
+	case BACKEND_GZIP:
+#if JSON_ZSTD
+	case BACKEND_ZSTD:
+#endif
+	{
+		static char buf[BENCH_ASYNC];
+		if (write) {
+			if (s->fp)
+				fclose(s->fp);
+			s->fp = tmpfile();
+		} else {
+			rewind(s->fp);
+		}
+#if JSON_ZSTD
+		if (s->backend == BACKEND_ZSTD) {
+			if (!json_init_file_zstd(json, &s->zfile, s->fp, write, 0, buf, sizeof(buf)))
+				abort();
+			break;
+		}
+#endif
+		if (!json_init_file_gz(json, &s->zfile, s->fp, write, Z_BEST_SPEED, buf, sizeof(buf)))
+			abort();
+		break;
+	}
+#endif
+	default:
+		abort();
+	}
+}
+
+static
+size_t stream_close(struct stream *s, bool write)
+{
+	switch (s->backend) {
+	case BACKEND_MEM:
+	case BACKEND_DIGEST:
+		return s->mem.pos;
+	case BACKEND_FILE:
+	case BACKEND_PREFETCH:
+	case BACKEND_GZIP:
+#if JSON_ZSTD
+	case BACKEND_ZSTD:
+#endif
+		/* compressed size for the codecs */
+		return (size_t)ftell(s->fp);
+	case BACKEND_CALLBACK:
+		return s->sink.pos;
+	case BACKEND_ASYNC:
+	case BACKEND_MMAP:
+		/* the FILE never saw the writes, only its descriptor did */
+		fseek(s->fp, 0, SEEK_END);
+		return (size_t)ftell(s->fp);
+	default:
+		abort();
+	}
+}
+
+/* measurement */
+
+static
+double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct result
+{
+	size_t bytes;
+	double seconds;
+};
+
+static
+bool run(const struct corpus *corpus, struct stream *s, struct data *data,
+         bool write, struct result *res)
+{
+	res->seconds = 0;
+	for (int i = 0; i < BENCH_REPEAT; ++i) {
+		json_t json;
+		stream_open(s, &json, write);
+		const double start = now();
+		bool ok = write ? corpus->write(&json, data) && json_finish(&json)
+		                : corpus->read(&json, data);
+		/* the reader thread & decompressors are released even if the read failed */
+		if (!write && s->backend >= BACKEND_PREFETCH)
+			ok = json_finish(&json) && ok;
+		const size_t bytes = stream_close(s, write);
+		const double elapsed = now() - start;
+		if (!ok)
+			return false;
+		if (i == 0 || elapsed < res->seconds)
+			res->seconds = elapsed;
+		res->bytes = bytes;
+		if (write)
+			s->len = bytes;
+	}
+	return true;
+}
+
+static
+bool report(json_t *out, const struct corpus *corpus, enum backend backend,
+            const char *op, const struct result *res)
+{
+	json_obj_t obj;
+	return json_write_object_begin(out, "result", &obj)
+	    && json_write_str(out, "corpus", corpus->name)
+	    && json_write_str(out, "family", corpus->family)
+	    && json_write_str(out, "backend", g_backend_names[backend])
+	    && json_write_str(out, "op", op)
+	    && json_write_uint64(out, "bytes", res->bytes)
+	    && json_write_uint64(out, "values", corpus->values)
+	    && json_write_double(out, "seconds", res->seconds)
+	    && json_write_double(out, "mb_per_s", res->bytes / res->seconds / 1e6)
+	    && json_write_double(out, "ns_per_value", res->seconds * 1e9 / corpus->values)
+	    && json_write_object_end(out);
+}
+
+static
+void data_init(struct data *data)
+{
+	static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789 \"\\/\n\t";
+
+	srand(1);
+	for (size_t i = 0; i < BENCH_POINTS; ++i) {
+		data->points[i].x = rand() % 200000 - 100000;
+		data->points[i].y = rand() % 200000 - 100000;
+	}
+	for (size_t i = 0; i < BENCH_STRINGS; ++i) {
+		const size_t len = 8 + rand() % (BENCH_STR_MAX - 8);
+		for (size_t j = 0; j < len; ++j) {
+			/* mostly plain text, with the occasional escaped character */
+			const size_t k = rand() % 64 == 0 ? 36 + rand() % 6 : rand() % 36;
+			data->strings[i][j] = alphabet[k];
+		}
+		data->strings[i][len] = 0;
+	}
+	for (size_t i = 0; i < BENCH_NUMBERS; ++i) {
+		data->doubles[i] = (rand() - RAND_MAX / 2) / 1e3 + rand() / (double)RAND_MAX;
+		data->walk[i] = (i ? data->walk[i - 1] : 250000.0) + (rand() % 2001 - 1000) / 1e3;
+		data->ints[i] = ((int64_t)rand() << 20) ^ rand();
+	}
+	for (size_t i = 0; i < BENCH_BLOB; ++i)
+		data->blob[i] = (uint8_t)rand();
+}
+
+/* checks: round trips the timings rely on, run once before them */
+
+static
+bool check_control_chars(void)
+{
+	char src[32], back[32], buf[256];
+	char c;
+	json_t json;
+	json_obj_t list;
+	json_mem_t mem = { .buf = buf, .len = sizeof(buf) };
+	for (size_t i = 1; i < 32; ++i)
+		src[i - 1] = (char)i;
+	src[31] = 0;
+	json_init_mem(&json, &mem);
+	CHECK(json_write_array_begin(&json, "", &list));
+	CHECK(json_write_str(&json, "", src));
+	CHECK(json_write_char(&json, "", '\x1b'));
+	CHECK(json_write_array_end(&json));
+
+	mem.len = mem.pos;
+	mem.pos = 0;
+	json_init_mem(&json, &mem);
+	CHECK(json_read_array_begin(&json, "", &list));
+	CHECK(json_read_str(&json, "", back, sizeof(back)) && strcmp(back, src) == 0);
+	CHECK(json_read_char(&json, "", &c) && c == '\x1b');
+	return json_read_array_end(&json);
+}
+
+/* Part reads growing the buffer by `step` up to the exact decoded size,
+ * into which a padded last quantum has to fit. */
+static
+bool check_blob_part(size_t n, size_t step)
+{
+	uint8_t src[64], back[64];
+	char buf[256];
+	json_t json;
+	json_obj_t root;
+	json_mem_t mem = { .buf = buf, .len = sizeof(buf) };
+	size_t len = 0, max = 0;
+	bool more = false;
+	for (size_t i = 0; i < n; ++i)
+		src[i] = (uint8_t)(i * 37 + n);
+	json_init_mem(&json, &mem);
+	CHECK(json_write_object_begin(&json, "root", &root));
+	CHECK(json_write_blob(&json, "blob", src, n));
+	CHECK(json_write_object_end(&json));
+
+	mem.len = mem.pos;
+	mem.pos = 0;
+	json_init_mem(&json, &mem);
+	CHECK(json_read_object_begin(&json, "root", &root));
+	do {
+		max = max + step < n ? max + step : n;
+		CHECK(json_read_blob_part(&json, "blob", back, max, &len, &more));
+	} while (more && max < n);
+	CHECK(!more && len == n && memcmp(back, src, n) == 0);
+	return json_read_object_end(&json);
+}
+
+static
+bool check_blobs(void)
+{
+	static const char padded[] = "\"QQ==QUJD\"";
+	uint8_t back[8];
+	size_t len;
+	for (size_t n = 1; n <= 64; ++n)
+		for (size_t step = 1; step <= 8; ++step)
+			CHECK(check_blob_part(n, step));
+	/* padding anywhere but at the end is malformed, wherever chunks split */
+	for (size_t max = 1; max <= sizeof(back); ++max) {
+		json_t json;
+		json_mem_t mem = { .buf = (char *)padded, .len = sizeof(padded) - 1 };
+		json_init_mem(&json, &mem);
+		CHECK(!json_read_blob(&json, "", back, max, &len));
+	}
+	return true;
+}
+
+static const struct check
+{
+	const char *name;
+	bool(*run)(void);
+} g_checks[] = {
+	{ "control characters", check_control_chars },
+	{ "blob",               check_blobs         },
+};
+
+static
+bool data_alloc(struct data *data)
+{
+	data->points  = malloc(BENCH_POINTS * sizeof(*data->points));
+	data->strings = malloc(BENCH_STRINGS * sizeof(*data->strings));
+	data->doubles = malloc(BENCH_NUMBERS * sizeof(*data->doubles));
+	data->walk    = malloc(BENCH_NUMBERS * sizeof(*data->walk));
+	data->ints    = malloc(BENCH_NUMBERS * sizeof(*data->ints));
+	data->blob    = malloc(BENCH_BLOB);
+	return data->points && data->strings && data->doubles && data->walk && data->ints && data->blob;
+}
+
+/* Fills the read side with garbage, so a read that stores nothing fails the
+ * comparison instead of finding the previous backend's values. */
+static
+void data_clear(struct data *data)
+{
+	memset(data->points, 0xa5, BENCH_POINTS * sizeof(*data->points));
+	memset(data->strings, 0xa5, BENCH_STRINGS * sizeof(*data->strings));
+	memset(data->doubles, 0xa5, BENCH_NUMBERS * sizeof(*data->doubles));
+	memset(data->walk, 0xa5, BENCH_NUMBERS * sizeof(*data->walk));
+	memset(data->ints, 0xa5, BENCH_NUMBERS * sizeof(*data->ints));
+	memset(data->blob, 0xa5, BENCH_BLOB);
+}
+
+int main(void)
+{
+	/* reads go to `back`: the fixed-precision corpora read quantized values,
+	 * which would otherwise change what every later pass formats */
+	struct data data, back;
+	char *buf = malloc(BENCH_BUF);
+	static char report_buf[1 << 16];
+	json_mem_t report_mem = { .buf = report_buf, .len = sizeof(report_buf) };
+	json_t out;
+	json_obj_t root, list;
+	int ret = 0;
+
+	if (!data_alloc(&data) || !data_alloc(&back) || !buf) {
+		fprintf(stderr, "bench: out of memory\n");
+		return 1;
+	}
+	data_init(&data);
+	for (size_t i = 0; i < sizeof(g_checks) / sizeof(g_checks[0]); ++i) {
+		if (!g_checks[i].run()) {
+			fprintf(stderr, "bench: %s check failed\n", g_checks[i].name);
+			ret = 1;
+		}
+	}
+
+	json_init_mem(&out, &report_mem);
+	json_write_object_begin(&out, "bench", &root);
+	json_write_str(&out, "build", BENCH_BUILD);
+	json_write_bool(&out, "pretty", JSON_PRETTY_PRINT);
+	json_write_array_begin(&out, "results", &list);
+
+	for (int threaded = 0; threaded < 2; ++threaded)
+	for (size_t c = 0; c < sizeof(g_corpora) / sizeof(g_corpora[0]); ++c) {
+		for (int b = 0; b < BENCH_BACKENDS; ++b) {
+			if (backend_threaded((enum backend)b) != threaded)
+				continue;
+			struct stream s = { .backend = (enum backend)b, .buf = buf };
+			struct result res;
+			if (!run(&g_corpora[c], &s, &data, true, &res)) {
+				fprintf(stderr, "bench: %s/%s write failed\n", g_corpora[c].name, g_backend_names[b]);
+				ret = 1;
+			} else {
+				if (backend_reports((enum backend)b, true))
+					report(&out, &g_corpora[c], (enum backend)b, "write", &res);
+				data_clear(&back);
+				if (!run(&g_corpora[c], &s, &back, false, &res)) {
+					fprintf(stderr, "bench: %s/%s read failed\n", g_corpora[c].name, g_backend_names[b]);
+					ret = 1;
+				} else if (!g_corpora[c].same(&data, &back)) {
+					fprintf(stderr, "bench: %s/%s read back other values\n", g_corpora[c].name, g_backend_names[b]);
+					ret = 1;
+				} else if (backend_reports((enum backend)b, false)) {
+					report(&out, &g_corpora[c], (enum backend)b, "read", &res);
+				}
+			}
+			if (s.fp)
+				fclose(s.fp);
+		}
+	}
+
+	if (!json_write_array_end(&out) || !json_write_object_end(&out)) {
+		fprintf(stderr, "bench: report buffer too small\n");
+		return 1;
+	}
+	fwrite(report_mem.buf, 1, report_mem.pos, stdout);
+	fputc('\n', stdout);
+	return ret;
+}
@@ -0,0 +1,56 @@
+#include "json.hpp"
+#include <cstdio>
+#include <cstring>
+
+struct point
+{
+	int32_t x;
+	int32_t y;
+};
+
+struct obj
+{
+	std::string name;
+	std::vector<point> points;
+	std::array<double, 3> origin;
+};
+
+template<> struct jsoon::meta<point>
+{
+	static constexpr auto members = jsoon::members(
+		jsoon::field("x", &point::x),
+		jsoon::field("y", &point::y));
+};
+
+template<> struct jsoon::meta<obj>
+{
+	static constexpr auto members = jsoon::members(
+		jsoon::field("name", &obj::name),
+		jsoon::count("n", &obj::points),
+		jsoon::field("points", &obj::points),
+		jsoon::field("origin", &obj::origin));
+};
+
+static const char *g_str = "{\"name\": \"square\",\"n\": 4,\"points\": [{\"x\": 0,\"y\": 0},{\"x\": 10,\"y\": 0},{\"x\": 10,\"y\": 10},{\"x\": 0,\"y\": 10}],\"origin\": [0.5,0.5,0]}";
+
+int main()
+{
+	obj o;
+	json_t json;
+	json_mem_t mem = { const_cast<char *>(g_str), 0, strlen(g_str) };
+
+	json_init_mem(&json, &mem);
+	if (!jsoon::read(&json, o)) {
+		fprintf(stderr, "err @ jsoon::read\n");
+		return 1;
+	}
+
+	json_init_file(&json, stdout);
+	if (!jsoon::write(&json, o)) {
+		fprintf(stderr, "err @ jsoon::write\n");
+		return 1;
+	}
+	fputc('\n', stdout);
+
+	return 0;
+}
@@ -1,30 +1,50 @@
 #include <ctype.h>
 #include <assert.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <float.h>
 #include "json.h"
 
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /* initialization */
 
 #define json__min(a, b) ((a) < (b) ? (a) : (b))
 
-static
+#if defined(__GNUC__)
+#define json__unlikely(x) __builtin_expect(!!(x), 0)
+#define JSON__NOINLINE __attribute__((noinline))
+#else
+#define json__unlikely(x) (x)
+#define JSON__NOINLINE
+#endif
+
+#define JSON__CAT_(a, b) a##b
+#define JSON__CAT(a, b) JSON__CAT_(a, b)
+
+static inline
 int json__mem_fgetc(void *user)
 {
 	json_mem_t *mem = user;
-	return mem->pos < mem->len ? mem->buf[mem->pos++] : EOF;
+	return mem->pos < mem->len ? (unsigned char)mem->buf[mem->pos++] : EOF;
 }
 
-static
+static inline
 int json__mem_ungetc(int c, void *user)
 {
 	json_mem_t *mem = user;
-	return mem->pos > 0 && mem->buf[mem->pos-1] == c ? (mem->pos--, c) : EOF;
+	return mem->pos > 0 && (unsigned char)mem->buf[mem->pos-1] == c ? (mem->pos--, c) : EOF;
 }
 
-static
+static inline
 size_t json__mem_fread(void *ptr, size_t size, size_t nmemb, void *user)
 {
 	assert(size == 1);
@@ -35,7 +55,7 @@ size_t json__mem_fread(void *ptr, size_t size, size_t nmemb, void *user)
 	return len;
 }
 
-static
+static inline
 size_t json__mem_fwrite(const void *ptr, size_t size, size_t nmemb, void *user)
 {
 	assert(size == 1);
@@ -46,7 +66,7 @@ size_t json__mem_fwrite(const void *ptr, size_t size, size_t nmemb, void *user)
 	return len;
 }
 
-static
+static inline
 int json__mem_fputc(int c, void *user)
 {
 	json_mem_t *mem = user;
@@ -54,41 +74,90 @@ int json__mem_fputc(int c, void *user)
 }
 
 static
+const char *json__mem_view(size_t *len, void *user)
+{
+	json_mem_t *mem = user;
+	*len = mem->len - mem->pos;
+	return &mem->buf[mem->pos];
+}
+
+static
+long json__mem_ftell(void *user)
+{
+	json_mem_t *mem = user;
+	return (long)mem->pos;
+}
+
+static
+int json__mem_fseek(long offset, int whence, void *user)
+{
+	json_mem_t *mem = user;
+	const long base = whence == SEEK_SET ? 0
+	                : whence == SEEK_CUR ? (long)mem->pos
+	                :                      (long)mem->len;
+	if (base + offset < 0 || (size_t)(base + offset) > mem->len)
+		return -1;
+	mem->pos = (size_t)(base + offset);
+	return 0;
+}
+
+static inline
 int json__file_fgetc(void *user)
 {
 	return fgetc(user);
 }
 
-static
+static inline
 int json__file_ungetc(int c, void *user)
 {
 	return ungetc(c, user);
 }
 
-static
+static inline
 size_t json__file_fread(void *ptr, size_t size, size_t nmemb, void *user)
 {
 	return fread(ptr, size, nmemb, user);
 }
 
-static
+static inline
 size_t json__file_fwrite(const void *ptr, size_t size, size_t nmemb, void *user)
 {
 	return fwrite(ptr, size, nmemb, user);
 }
 
-static
+static inline
 int json__file_fputc(int c, void *user)
 {
 	return fputc(c, user);
 }
 
+static
+long json__file_ftell(void *user)
+{
+	return ftell(user);
+}
+
+static
+int json__file_fseek(long offset, int whence, void *user)
+{
+	return fseek(user, offset, whence);
+}
+
+static
+int json__file_finish(void *user)
+{
+	return fflush(user) == 0 && !ferror((FILE *)user) ? 0 : EOF;
+}
+
 const json_io_t g_json_io_mem = {
 	.fgetc  = json__mem_fgetc,
 	.ungetc = json__mem_ungetc,
 	.fread  = json__mem_fread,
 	.fwrite = json__mem_fwrite,
 	.fputc  = json__mem_fputc,
+	.ftell  = json__mem_ftell,
+	.fseek  = json__mem_fseek,
+	.view   = json__mem_view,
 };
 
 const json_io_t g_json_io_file = {
@@ -97,18 +166,36 @@ const json_io_t g_json_io_file = {
 	.fread  = json__file_fread,
 	.fwrite = json__file_fwrite,
 	.fputc  = json__file_fputc,
+	.ftell  = json__file_ftell,
+	.fseek  = json__file_fseek,
+	.finish = json__file_finish,
 };
 
 void json_init(json_t *json, json_io_t io, void *user)
 {
+#ifdef JSON_IO_STATIC
+	assert(io.fgetc == JSON__CAT(JSON_IO_STATIC, fgetc) && "backend differs from JSON_IO_STATIC");
+#endif
 	json->user = user;
 	json->io = io;
 	json->indent = 0;
-	json->line = 1;
+	json->label = NULL;
+	json->arena = NULL;
+	json->precision = JSON_PRECISION_EXACT;
+	json->precision_n = 0;
+	json->nahead = 0;
+	json->peeked = false;
+	json->peek_long = false;
 	json->root.n = 0;
 	json->root.is_array = true;
+	json->root.label = NULL;
 	json->root.prev = NULL;
 	json->cur = &json->root;
+#if JSON_STATS
+	json->trace = NULL;
+	json->trace_user = NULL;
+	json_reset_stats(json);
+#endif
 }
 
 void json_init_file(json_t *json, FILE *fp)
@@ -121,14 +208,389 @@ void json_init_mem(json_t *json, json_mem_t *mem)
 	json_init(json, g_json_io_mem, mem);
 }
 
+void json_set_arena(json_t *json, json_arena_t *arena)
+{
+	json->arena = arena;
+}
+
+void json_set_precision(json_t *json, json_precision_t precision, int n)
+{
+	assert(precision != JSON_PRECISION_DECIMALS || (n >= 0 && n <= 19));
+	assert(precision != JSON_PRECISION_DIGITS || (n >= 1 && n <= 17));
+	json->precision = precision;
+	json->precision_n = n;
+}
+
+bool json_finish(json_t *json)
+{
+	return json->io.finish == NULL || json->io.finish(json->user) == 0;
+}
+
+void *json_arena_alloc(json_arena_t *arena, size_t size, size_t align)
+{
+	assert(align > 0 && (align & (align - 1)) == 0);
+	const uintptr_t base = (uintptr_t)arena->buf;
+	const size_t pos = ((base + arena->pos + align - 1) & ~(uintptr_t)(align - 1)) - base;
+	if (pos > arena->len || size > arena->len - pos)
+		return NULL;
+	arena->pos = pos + size;
+	return &arena->buf[pos];
+}
+
+void json_arena_reset(json_arena_t *arena)
+{
+	arena->pos = 0;
+}
+
+#if JSON_STATS
+void json_set_trace(json_t *json, json_trace_fn trace, void *user)
+{
+	json->trace = trace;
+	json->trace_user = user;
+}
+
+void json_reset_stats(json_t *json)
+{
+	memset(&json->stats, 0, sizeof(json->stats));
+}
+#endif
+
+/* instrumentation */
+
+/* With JSON_IO_STATIC the backend is fixed at compile time and called
+ * directly, so it can be inlined into the parsing & formatting loops. */
+#ifdef JSON_IO_STATIC
+#define json__io_fgetc(json)           JSON__CAT(JSON_IO_STATIC, fgetc)((json)->user)
+#define json__io_fread(json, ptr, n)   JSON__CAT(JSON_IO_STATIC, fread)((ptr), 1, (n), (json)->user)
+#define json__io_fwrite(json, ptr, n)  JSON__CAT(JSON_IO_STATIC, fwrite)((ptr), 1, (n), (json)->user)
+#define json__io_fputc(json, c)        JSON__CAT(JSON_IO_STATIC, fputc)((c), (json)->user)
+#else
+#define json__io_fgetc(json)           (json)->io.fgetc((json)->user)
+#define json__io_fread(json, ptr, n)   (json)->io.fread((ptr), 1, (n), (json)->user)
+#define json__io_fwrite(json, ptr, n)  (json)->io.fwrite((ptr), 1, (n), (json)->user)
+#define json__io_fputc(json, c)        (json)->io.fputc((c), (json)->user)
+#endif
+
+#if JSON_STATS && JSON_STATS_TIMING
+#ifndef JSON_STATS_CLOCK
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JSON_STATS_CLOCK() __builtin_ia32_rdtsc()
+#else
+#include <time.h>
+#define JSON_STATS_CLOCK() ((uint64_t)clock())
+#endif
+#endif
+#define json__phase_begin() const uint64_t json__phase_start = JSON_STATS_CLOCK()
+#define json__phase_end(json, phase) ((json)->stats.cycles[phase] += JSON_STATS_CLOCK() - json__phase_start)
+#else
+#define json__phase_begin() ((void)0)
+#define json__phase_end(json, phase) ((void)0)
+#endif
+
+#if JSON_STATS
+
+#define json__count_value(json, type) (++(json)->stats.values[type])
+
+static
+void json__trace(json_t *json, const char *label, bool is_array, bool begin)
+{
+	if (json->trace)
+		json->trace(json, label, is_array, begin, json->trace_user);
+}
+
+static
+int json__raw_fgetc(json_t *json)
+{
+	json__phase_begin();
+	const int c = json__io_fgetc(json);
+	json__phase_end(json, JSON_PHASE_IO);
+	++json->stats.io_calls;
+	json->stats.bytes_in += c != EOF;
+	return c;
+}
+
+static
+size_t json__raw_fread(json_t *json, void *ptr, size_t n)
+{
+	json__phase_begin();
+	const size_t r = json__io_fread(json, ptr, n);
+	json__phase_end(json, JSON_PHASE_IO);
+	++json->stats.io_calls;
+	json->stats.bytes_in += r;
+	return r;
+}
+
+static
+size_t json__fwrite(json_t *json, const void *ptr, size_t n)
+{
+	json__phase_begin();
+	const size_t r = json__io_fwrite(json, ptr, n);
+	json__phase_end(json, JSON_PHASE_IO);
+	++json->stats.io_calls;
+	json->stats.bytes_out += r;
+	return r;
+}
+
+static
+int json__fputc(json_t *json, int c)
+{
+	json__phase_begin();
+	const int r = json__io_fputc(json, c);
+	json__phase_end(json, JSON_PHASE_IO);
+	++json->stats.io_calls;
+	json->stats.bytes_out += r != EOF;
+	return r;
+}
+
+#else
+
+#define json__count_value(json, type) ((void)0)
+#define json__trace(json, label, is_array, begin) ((void)0)
+#define json__raw_fgetc(json) json__io_fgetc(json)
+#define json__raw_fread(json, ptr, n) json__io_fread(json, ptr, n)
+#define json__fwrite(json, ptr, n) json__io_fwrite(json, ptr, n)
+#define json__fputc(json, c) json__io_fputc(json, c)
+
+#endif
+
+/* lookahead */
+
+/* Bytes put back by the reader wait in json_t rather than in the backend,
+ * so up to JSON_LOOKAHEAD of them can be outstanding at once. */
+
+/* nahead once a put-back byte didn't fit: with it lost, every read from
+ * then on fails instead of going on without it. */
+#define JSON__AHEAD_LOST (JSON_LOOKAHEAD + 1)
+
+static inline
+int json__fgetc(json_t *json)
+{
+	if (json->nahead == 0)
+		return json__raw_fgetc(json);
+	if (json->nahead == JSON__AHEAD_LOST)
+		return EOF;
+#if JSON_STATS
+	++json->stats.bytes_in;
+#endif
+	return (unsigned char)json->ahead[--json->nahead];
+}
+
+static inline
+int json__ungetc(json_t *json, int c)
+{
+	if (c == EOF)
+		return EOF;
+	if (json->nahead >= JSON_LOOKAHEAD) {
+		assert(json->nahead == JSON__AHEAD_LOST && "lookahead overflow");
+		json->nahead = JSON__AHEAD_LOST;
+		return EOF;
+	}
+#if JSON_STATS
+	--json->stats.bytes_in;
+#endif
+	json->ahead[json->nahead++] = (char)c;
+	return c;
+}
+
+static
+size_t json__fread(json_t *json, void *ptr, size_t n)
+{
+	char *dst = ptr;
+	size_t i = 0;
+	if (json->nahead == JSON__AHEAD_LOST)
+		return 0;
+	for (; i < n && json->nahead > 0; ++i)
+		dst[i] = (char)json__fgetc(json);
+	return i < n ? i + json__raw_fread(json, dst + i, n - i) : i;
+}
+
+/* Hands the lookahead back to a seekable backend so that its position, view
+ * & seeks line up with what the reader has consumed. */
+static
+bool json__sync(json_t *json)
+{
+	if (json->nahead == 0)
+		return true;
+	if (   json->nahead == JSON__AHEAD_LOST
+	    || !json->io.fseek
+	    || json->io.fseek(-(long)json->nahead, SEEK_CUR, json->user) != 0)
+		return false;
+	json->nahead = 0;
+	return true;
+}
+
+/* base64 */
+
+#define JSON__BLOB_CHUNK 256 /* quanta (3 bytes in, 4 chars out) per I/O call */
+
+static const char json__b64_enc[65] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const uint8_t json__b64_dec[256] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+	0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+	0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+/* Encodes n bytes into 4*ceil(n/3) characters, padding the final quantum. */
+static
+size_t json__b64_encode(char *dst, const uint8_t *src, size_t n)
+{
+	char *p = dst;
+
+#if defined(__SSSE3__)
+	/* 12 bytes in, 16 characters out per step.  The load reads 16 bytes,
+	 * so stop while at least 4 bytes of slack remain in the source. */
+	const __m128i shuf  = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+	const __m128i lut   = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4,
+	                                    -4, -4, -4, -4, -19, -16, 0, 0);
+	while (n >= 16) {
+		__m128i in = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), shuf);
+		const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+		const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+		const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+		const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+		in = _mm_or_si128(t1, t3);
+
+		/* Map the 6-bit indices onto the alphabet with a single shuffle. */
+		__m128i idx = _mm_subs_epu8(in, _mm_set1_epi8(51));
+		idx = _mm_sub_epi8(idx, _mm_cmpgt_epi8(in, _mm_set1_epi8(25)));
+		_mm_storeu_si128((__m128i *)p, _mm_add_epi8(in, _mm_shuffle_epi8(lut, idx)));
+
+		src += 12;
+		n   -= 12;
+		p   += 16;
+	}
+#endif
+
+	for (; n >= 3; n -= 3, src += 3, p += 4) {
+		const uint32_t v = (uint32_t)src[0] << 16 | (uint32_t)src[1] << 8 | src[2];
+		p[0] = json__b64_enc[(v >> 18) & 0x3f];
+		p[1] = json__b64_enc[(v >> 12) & 0x3f];
+		p[2] = json__b64_enc[(v >>  6) & 0x3f];
+		p[3] = json__b64_enc[(v >>  0) & 0x3f];
+	}
+
+	if (n > 0) {
+		const uint32_t v = (uint32_t)src[0] << 16 | (n > 1 ? (uint32_t)src[1] << 8 : 0);
+		p[0] = json__b64_enc[(v >> 18) & 0x3f];
+		p[1] = json__b64_enc[(v >> 12) & 0x3f];
+		p[2] = n > 1 ? json__b64_enc[(v >> 6) & 0x3f] : '=';
+		p[3] = '=';
+		p += 4;
+	}
+
+	return p - dst;
+}
+
+/* Decodes n characters (a multiple of 4) into dst.  Padding is only
+ * accepted in the final quantum, and only when `last` says the string ends
+ * there.  Returns false on malformed input. */
+static
+bool json__b64_decode(uint8_t *dst, const char *src, size_t n, bool last, size_t *len)
+{
+	uint8_t *p = dst;
+
+	if (n % 4 != 0)
+		return false;
+
+#if defined(__SSSE3__)
+	/* 16 characters in, 12 bytes out per step.  The store writes 16 bytes,
+	 * so keep at least two more quanta (>= 4 output bytes) behind it.  Any
+	 * character outside the alphabet, including '=', drops to the scalar
+	 * loop which reports the error or handles the padding. */
+	const __m128i lut_lo   = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+	                                       0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m128i lut_hi   = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+	                                       0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+	                                       0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask_2f  = _mm_set1_epi8(0x2f);
+	while (n >= 24) {
+		__m128i str = _mm_loadu_si128((const __m128i *)src);
+		const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+		const __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+		const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+		const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+		if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())))
+			break;
+
+		const __m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+		str = _mm_add_epi8(str, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles)));
+
+		/* Pack four 6-bit values into three bytes per 32-bit lane. */
+		str = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+		str = _mm_madd_epi16(str, _mm_set1_epi32(0x00011000));
+		str = _mm_shuffle_epi8(str, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+		                                          -1, -1, -1, -1));
+		_mm_storeu_si128((__m128i *)p, str);
+
+		src += 16;
+		n   -= 16;
+		p   += 12;
+	}
+#endif
+
+	for (; n > 0; n -= 4, src += 4) {
+		const uint8_t a = json__b64_dec[(uint8_t)src[0]];
+		const uint8_t b = json__b64_dec[(uint8_t)src[1]];
+		const uint8_t c = json__b64_dec[(uint8_t)src[2]];
+		const uint8_t d = json__b64_dec[(uint8_t)src[3]];
+		if (((a | b | c | d) & 0xc0) == 0) {
+			const uint32_t v = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | d;
+			*p++ = (uint8_t)(v >> 16);
+			*p++ = (uint8_t)(v >>  8);
+			*p++ = (uint8_t)(v >>  0);
+		} else if (   last && n == 4 && (a | b) < 64 && src[3] == '='
+		           && (c < 64 || src[2] == '=')) {
+			*p++ = (uint8_t)(a << 2 | b >> 4);
+			if (c < 64)
+				*p++ = (uint8_t)(b << 4 | c >> 2);
+		} else {
+			return false;
+		}
+	}
+
+	*len = p - dst;
+	return true;
+}
+
+size_t json_blob_encoded_size(size_t n)
+{
+	return (n + 2) / 3 * 4;
+}
+
+size_t json_blob_decoded_size(const char *str, size_t n)
+{
+	if (n % 4 != 0)
+		return 0;
+	if (n > 0 && str[n-1] == '=')
+		--n;
+	if (n > 0 && str[n-1] == '=')
+		--n;
+	return n / 4 * 3 + (n % 4 ? n % 4 - 1 : 0);
+}
+
 /* writing */
 
 static
 bool json__write_newline(json_t *json)
 {
 #if JSON_PRETTY_PRINT
-	++json->line;
-	return json->io.fputc('\n', json->user) != EOF;
+	return json__fputc(json, '\n') != EOF;
 #else
 	return true;
 #endif
@@ -137,7 +599,7 @@ bool json__write_newline(json_t *json)
 static
 bool json__write_member_separator(json_t *json)
 {
-	if (json->cur->n > 0 && json->io.fputc(',', json->user) == EOF)
+	if (json->cur->n > 0 && json__fputc(json, ',') == EOF)
 		return false;
 	if (json->cur != &json->root && !json__write_newline(json))
 		return false;
@@ -151,7 +613,7 @@ bool json__write_indent(json_t *json)
 #if JSON_PRETTY_PRINT && JSON_INDENT_SIZE
 	for (size_t i = 0; i < json->indent; ++i)
 		for (size_t j = 0; j < JSON_INDENT_SIZE; ++j)
-			if (json->io.fputc(' ', json->user) == EOF)
+			if (json__fputc(json, ' ') == EOF)
 				return false;
 #endif
 	return true;
@@ -160,9 +622,9 @@ bool json__write_indent(json_t *json)
 static
 bool json__write_strn(json_t *json, const char *buf, size_t n)
 {
-	return json->io.fputc('"', json->user) != EOF
-	    && json->io.fwrite(buf, 1, n, json->user) == n
-	    && json->io.fputc('"', json->user) != EOF;
+	return json__fputc(json, '"') != EOF
+	    && json__fwrite(json, buf, n) == n
+	    && json__fputc(json, '"') != EOF;
 }
 
 static
@@ -172,25 +634,31 @@ bool json__write_char(json_t *json, char c)
 	case '"':
 	case '\\':
 	case '/':
-		return json->io.fputc('\\', json->user) != EOF
-		    && json->io.fputc(c,    json->user) != EOF;
+		return json__fputc(json, '\\') != EOF
+		    && json__fputc(json, c) != EOF;
 	case '\b':
-		return json->io.fputc('\\', json->user) != EOF
-		    && json->io.fputc('b',  json->user) != EOF;
+		return json__fputc(json, '\\') != EOF
+		    && json__fputc(json, 'b') != EOF;
 	case '\f':
-		return json->io.fputc('\\', json->user) != EOF
-		    && json->io.fputc('f',  json->user) != EOF;
+		return json__fputc(json, '\\') != EOF
+		    && json__fputc(json, 'f') != EOF;
 	case '\n':
-		return json->io.fputc('\\', json->user) != EOF
-		    && json->io.fputc('n',  json->user) != EOF;
+		return json__fputc(json, '\\') != EOF
+		    && json__fputc(json, 'n') != EOF;
 	case '\r':
-		return json->io.fputc('\\', json->user) != EOF
-		    && json->io.fputc('r',  json->user) != EOF;
+		return json__fputc(json, '\\') != EOF
+		    && json__fputc(json, 'r') != EOF;
 	case '\t':
-		return json->io.fputc('\\', json->user) != EOF
-		    && json->io.fputc('t',  json->user) != EOF;
+		return json__fputc(json, '\\') != EOF
+		    && json__fputc(json, 't') != EOF;
 	default:
-		return json->io.fputc(c, json->user) != EOF;
+		/* the reader takes no raw control characters, so neither may the
+		 * writer emit them */
+		if ((unsigned char)c < 0x20) {
+			const char esc[6] = { '\\', 'u', '0', '0', "01"[c >> 4], "0123456789abcdef"[c & 0xf] };
+			return json__fwrite(json, esc, sizeof(esc)) == sizeof(esc);
+		}
+		return json__fputc(json, c) != EOF;
 	}
 }
 
@@ -209,24 +677,28 @@ bool json__write_str_(json_t *json, const char *buf)
 static
 bool json__write_str(json_t *json, const char *buf)
 {
-	return json->io.fputc('"', json->user) != EOF
-	    && json__write_str_(json, buf)
-	    && json->io.fputc('"', json->user) != EOF;
+	json__phase_begin();
+	const bool ok = json__fputc(json, '"') != EOF
+	             && json__write_str_(json, buf)
+	             && json__fputc(json, '"') != EOF;
+	json__phase_end(json, JSON_PHASE_STRING);
+	return ok;
 }
 
 static
 bool json__write_colon(json_t *json)
 {
 #if JSON_PRETTY_PRINT
-	return json->io.fwrite(": ", 1, 2, json->user);
+	return json__fwrite(json, ": ", 2);
 #else
-	return json->io.fputc(':', json->user);
+	return json__fputc(json, ':');
 #endif
 }
 
 static
 bool json__write_label(json_t *json, const char *label)
 {
+	json->label = label;
 	return json__write_member_separator(json)
 	    && json__write_indent(json)
 	    && (   json->cur->is_array
@@ -235,17 +707,44 @@ bool json__write_label(json_t *json, const char *label)
 }
 
 static
-void json__push_obj(json_t *json, json_obj_t *obj, bool is_array)
+void json__push_obj(json_t *json, json_obj_t *obj, const char *label, bool is_array)
 {
 	++json->indent;
 
 	obj->n = 0;
 	obj->is_array = is_array;
+	obj->label = label;
 	obj->prev = json->cur;
 
 	json->cur = obj;
 }
 
+/* Counts & traces the object/array json__push_obj opened, once its bracket
+ * has been written or read. */
+static
+void json__opened(json_t *json)
+{
+#if JSON_STATS
+	json__count_value(json, json->cur->is_array ? JSON_TYPE_ARRAY : JSON_TYPE_OBJECT);
+	if (json->indent > json->stats.max_depth)
+		json->stats.max_depth = json->indent;
+	json__trace(json, json->cur->label, json->cur->is_array, true);
+#else
+	(void)json;
+#endif
+}
+
+/* Failure exit for functions that open their own json_obj_t: puts the
+ * nesting back as it was on entry, so that json_get_error never follows
+ * json->cur into a frame that has returned. */
+static
+bool json__unwind(json_t *json, json_obj_t *cur, size_t indent)
+{
+	json->cur = cur;
+	json->indent = indent;
+	return false;
+}
+
 static
 bool json__write_object_begin(json_t *json, const char *label,
                               bool is_array, json_obj_t *obj)
@@ -253,10 +752,11 @@ bool json__write_object_begin(json_t *json, const char *label,
 	const char open[] = { '{', '[' };
 
 	if (   !json__write_label(json, label)
-	    || json->io.fputc(open[is_array], json->user) == EOF)
+	    || json__fputc(json, open[is_array]) == EOF)
 		return false;
 
-	json__push_obj(json, obj, is_array);
+	json__push_obj(json, obj, label, is_array);
+	json__opened(json);
 	return true;
 }
 
@@ -275,9 +775,10 @@ bool json__write_object_end(json_t *json, bool is_array)
 	        || !json__write_indent(json)))
 		return false;
 
-	if (json->io.fputc(close[is_array], json->user) == EOF)
+	if (json__fputc(json, close[is_array]) == EOF)
 		return false;
 
+	json__trace(json, json->cur->label, is_array, false);
 	json->cur = json->cur->prev;
 	return true;
 }
@@ -294,9 +795,13 @@ bool json_write_object_end(json_t *json)
 
 bool json_write_raw_value(json_t *json, const char *label, const char *value)
 {
-	const size_t n = strlen(value);
+	return json_write_raw_valuen(json, label, value, strlen(value));
+}
+
+bool json_write_raw_valuen(json_t *json, const char *label, const char *value, size_t n)
+{
 	return json__write_label(json, label)
-	    && json->io.fwrite(value, 1, n, json->user) == n;
+	    && json__fwrite(json, value, n) == n;
 }
 
 bool json_write_array_begin(json_t *json, const char *label, json_obj_t *obj)
@@ -311,86 +816,261 @@ bool json_write_array_end(json_t *json)
 
 bool json_write_null(json_t *json, const char *label)
 {
+	json__count_value(json, JSON_TYPE_NULL);
 	return json__write_label(json, label)
-	    && json->io.fwrite("null", 1, 4, json->user) == 4;
+	    && json__fwrite(json, "null", 4) == 4;
 }
 
 bool json_write_bool(json_t *json, const char *label, bool val)
 {
+	json__count_value(json, JSON_TYPE_BOOL);
 	return json__write_label(json, label)
 	    &&   val
-	       ? json->io.fwrite("true", 1, 4, json->user) == 4
-	       : json->io.fwrite("false", 1, 5, json->user) == 5;
+	       ? json__fwrite(json, "true", 4) == 4
+	       : json__fwrite(json, "false", 5) == 5;
 }
 
 static
 bool json__write_number(json_t *json, const char *label, const char *str, int len, int max)
 {
 	assert(len < max); /* If this is ever hit, the library needs a larger buffer  */
+	json__count_value(json, JSON_TYPE_NUMBER);
 	return len > 0
 	    && len < max
 	    && json__write_label(json, label)
-	    && json->io.fwrite(str, 1, len, json->user) == len;
+	    && json__fwrite(json, str, len) == len;
 }
 
-bool json_write_int16(json_t *json, const char *label, int16_t val)
+/* Writes the decimal digits of v so that they end at `end`; returns the first. */
+static
+char *json__format_u64(char *end, uint64_t v)
+{
+	static const char pairs[] =
+		"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+		"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+		"8081828384858687888990919293949596979899";
+	while (v >= 100) {
+		const size_t i = (size_t)(v % 100) * 2;
+		v /= 100;
+		end -= 2;
+		memcpy(end, &pairs[i], 2);
+	}
+	if (v >= 10) {
+		end -= 2;
+		memcpy(end, &pairs[v * 2], 2);
+	} else {
+		*--end = (char)('0' + v);
+	}
+	return end;
+}
+
+static
+bool json__write_uint(json_t *json, const char *label, uint64_t val)
+{
+	char str[24];
+	json__phase_begin();
+	const char *p = json__format_u64(str + sizeof(str), val);
+	json__phase_end(json, JSON_PHASE_NUMBER);
+	return json__write_number(json, label, p, (int)(str + sizeof(str) - p), (int)sizeof(str) + 1);
+}
+
+static
+bool json__write_int(json_t *json, const char *label, int64_t val)
+{
+	char str[24];
+	json__phase_begin();
+	/* negate as unsigned so INT64_MIN survives */
+	char *p = json__format_u64(str + sizeof(str), val < 0 ? 0 - (uint64_t)val : (uint64_t)val);
+	if (val < 0)
+		*--p = '-';
+	json__phase_end(json, JSON_PHASE_NUMBER);
+	return json__write_number(json, label, p, (int)(str + sizeof(str) - p), (int)sizeof(str) + 1);
+}
+
+/* Every power of ten a double holds exactly. */
+static const double json__pow10[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/* Rounds x * 10^n to the nearest integer, ties to even, as printf would
+ * from the exact binary value.  The caller keeps the product below 1e19. */
+static
+uint64_t json__round_scaled(double x, int n)
+{
+	const double s = json__pow10[n];
+	const double y = x * s;
+	/* Dekker's product: y + err == x * s exactly, so a product that lands on
+	 * (or just across) a .5 is resolved the way the exact value would be */
+	const double split = 134217729.0; /* 2^27 + 1 */
+	const double xh = split * x - (split * x - x), xl = x - xh;
+	const double sh = split * s - (split * s - s), sl = s - sh;
+	const double err = ((xh * sh - y) + xh * sl + xl * sh) + xl * sl;
+	uint64_t q = (uint64_t)y;
+	if (y >= 9007199254740992.0) {
+		/* y is an integer & err may span several units: add its floor */
+		int64_t e = (int64_t)err;
+		e -= (double)e > err;
+		q += (uint64_t)e;
+		const double t = err - (double)e - 0.5;
+		return q + (t > 0 || (t == 0 && (q & 1)));
+	}
+	const double t = (y - (double)q - 0.5) + err;
+	if (t > 0 || (t == 0 && (q & 1)))
+		++q;
+	return q;
+}
+
+/* Writes the non-negative x rounded to `decimals` places so that it ends at
+ * `end`, without trailing zeros; returns the first char, or NULL if x is too
+ * large (or not finite) to be scaled into a uint64_t. */
+static
+char *json__format_fixed(char *end, double x, int decimals)
+{
+	uint64_t scale = 1;
+	for (int i = 0; i < decimals; ++i)
+		scale *= 10;
+	if (!(x * json__pow10[decimals] < 1e19))
+		return NULL;
+	const uint64_t q = json__round_scaled(x, decimals);
+	uint64_t frac = q % scale;
+	char *p = end;
+	if (frac > 0) {
+		while (frac % 10 == 0) {
+			frac /= 10;
+			--decimals;
+		}
+		p = json__format_u64(p, frac);
+		while (end - p < decimals)
+			*--p = '0';
+		*--p = '.';
+	}
+	return json__format_u64(p, q / scale);
+}
+
+/* Like json__format_fixed, rounded to `digits` significant digits. */
+static
+char *json__format_digits(char *end, double x, int digits)
+{
+	if (x == 0)
+		return json__format_u64(end, 0);
+	if (!(x >= 1e-15 && x < 1e17))
+		return NULL;
+	/* x is in [10^e, 10^(e+1)) */
+	int e = 0;
+	if (x >= 1) {
+		while (x >= json__pow10[e + 1])
+			++e;
+	} else {
+		while (x * json__pow10[-e] < 1)
+			--e;
+	}
+	const int decimals = digits - 1 - e;
+	if (decimals >= 0)
+		return decimals <= 19 ? json__format_fixed(end, x, decimals) : NULL;
+	/* fewer digits than the integer part has: round the integer part, which
+	 * x < 1e17 holds exactly, then pad with zeros */
+	uint64_t scale = 1;
+	for (int i = decimals; i < 0; ++i)
+		scale *= 10;
+	const uint64_t t = (uint64_t)x;
+	uint64_t q = t / scale;
+	const uint64_t r = (t % scale) * 2;
+	if (r > scale || (r == scale && (x > (double)t || (q & 1))))
+		++q;
+	end += decimals;
+	memset(end, '0', (size_t)-decimals);
+	return json__format_u64(end, q);
+}
+
+static
+char *json__format_real(char str[64], double val, bool single, json_precision_t precision, int n,
+                        int *len)
+{
+	char *end = str + 64;
+	char *p = NULL;
+	if (precision != JSON_PRECISION_EXACT) {
+		const double x = val < 0 ? -val : val;
+		p = precision == JSON_PRECISION_DECIMALS
+		  ? json__format_fixed(end, x, n)
+		  : json__format_digits(end, x, n);
+		/* no "-0" for values that round to zero */
+		if (p && val < 0 && (end - p != 1 || *p != '0'))
+			*--p = '-';
+	}
+	if (p) {
+		*len = (int)(end - p);
+		return p;
+	}
+	// CLEANUP - can write inf/-inf/nan, which is not legal JSON.
+	// See note in json__read_inf_or_nan.
+	// Values the fixed-point path can't take (huge, tiny, non-finite)
+	// go through snprintf; %f could need hundreds of chars, so %g.
+	if (precision == JSON_PRECISION_DIGITS)
+		*len = snprintf(str, 64, "%.*g", n, val);
+	else
+		*len = snprintf(str, 64, single ? "%.9g" : "%.17g", val); // FLT/DBL_DECIMAL_DIG
+	return str;
+}
+
+static
+bool json__write_real(json_t *json, const char *label, double val, bool single,
+                      json_precision_t precision, int n)
 {
 	char str[64];
-	int len = snprintf(str, 64, "%" PRId16, val);
-	return json__write_number(json, label, str, len, 64);
+	int len;
+	json__phase_begin();
+	const char *p = json__format_real(str, val, single, precision, n, &len);
+	json__phase_end(json, JSON_PHASE_NUMBER);
+	return json__write_number(json, label, p, len, 64);
+}
+
+bool json_write_int16(json_t *json, const char *label, int16_t val)
+{
+	return json__write_int(json, label, val);
 }
 
 bool json_write_uint16(json_t *json, const char *label, uint16_t val)
 {
-	char str[64];
-	int len = snprintf(str, 64, "%" PRIu16, val);
-	return json__write_number(json, label, str, len, 64);
+	return json__write_uint(json, label, val);
 }
 
 bool json_write_int32(json_t *json, const char *label, int32_t val)
 {
-	char str[64];
-	int len = snprintf(str, 64, "%" PRId32, val);
-	return json__write_number(json, label, str, len, 64);
+	return json__write_int(json, label, val);
 }
 
 bool json_write_uint32(json_t *json, const char *label, uint32_t val)
 {
-	char str[64];
-	int len = snprintf(str, 64, "%" PRIu32, val);
-	return json__write_number(json, label, str, len, 64);
+	return json__write_uint(json, label, val);
 }
 
 bool json_write_float(json_t *json, const char *label, float val)
 {
-	char str[64];
-	// CLEANUP - can write inf/-inf/nan, which is not legal JSON.
-	// See note in json__read_inf_or_nan.
-	int len = snprintf(str, 64, "%.9g", val); // FLT_DECIMAL_DIG=9
-	return json__write_number(json, label, str, len, 64);
+	return json__write_real(json, label, val, true, json->precision, json->precision_n);
 }
 
 bool json_write_int64(json_t *json, const char *label, int64_t val)
 {
-	char str[64];
-	int len = snprintf(str, 64, "%" PRId64, val);
-	return json__write_number(json, label, str, len, 64);
+	return json__write_int(json, label, val);
 }
 
 bool json_write_uint64(json_t *json, const char *label, uint64_t val)
 {
-	char str[64];
-	int len = snprintf(str, 64, "%" PRIu64, val);
-	return json__write_number(json, label, str, len, 64);
+	return json__write_uint(json, label, val);
 }
 
 bool json_write_double(json_t *json, const char *label, double val)
 {
-	char str[64];
-	// CLEANUP - can write inf/-inf/nan, which is not legal JSON.
-	// See note in json__read_inf_or_nan.
-	int len = snprintf(str, 64, "%.17g", val); // DBL_DECIMAL_DIG=17
-	return json__write_number(json, label, str, len, 64);
+	return json__write_real(json, label, val, false, json->precision, json->precision_n);
+}
+
+bool json_write_double_prec(json_t *json, const char *label, double val,
+                            json_precision_t precision, int n)
+{
+	assert(precision != JSON_PRECISION_DECIMALS || (n >= 0 && n <= 19));
+	assert(precision != JSON_PRECISION_DIGITS || (n >= 1 && n <= 17));
+	return json__write_real(json, label, val, false, precision, n);
 }
 
 bool json_write_char(json_t *json, const char *label, char val)
@@ -401,34 +1081,71 @@ bool json_write_char(json_t *json, const char *label, char val)
 
 bool json_write_str(json_t *json, const char *label, const char *val)
 {
+	json__count_value(json, JSON_TYPE_STRING);
 	return json__write_label(json, label)
 	    && json__write_str(json, val);
 }
 
 bool json_write_strn(json_t *json, const char *label, const char *val, size_t n)
 {
+	json__count_value(json, JSON_TYPE_STRING);
 	return json__write_label(json, label)
 	    && json__write_strn(json, val, n);
 }
 
+bool json_write_strn_escaped(json_t *json, const char *label, const char *val, size_t n)
+{
+	json__count_value(json, JSON_TYPE_STRING);
+	if (   !json__write_label(json, label)
+	    || json__fputc(json, '"') == EOF)
+		return false;
+	for (size_t i = 0; i < n; ++i)
+		if (!json__write_char(json, val[i]))
+			return false;
+	return json__fputc(json, '"') != EOF;
+}
+
 bool json_write_str_unescaped(json_t *json, const char *label, const char *val)
 {
+	json__count_value(json, JSON_TYPE_STRING);
 	return json__write_label(json, label)
 	    && json__write_strn(json, val, strlen(val));
 }
 
+bool json_write_blob(json_t *json, const char *label, const void *data, size_t n)
+{
+	const uint8_t *p = data;
+	char buf[JSON__BLOB_CHUNK * 4];
+
+	json__count_value(json, JSON_TYPE_STRING);
+	if (   !json__write_label(json, label)
+	    || json__fputc(json, '"') == EOF)
+		return false;
+
+	while (n > 0) {
+		const size_t chunk = json__min(n, JSON__BLOB_CHUNK * 3);
+		const size_t len = json__b64_encode(buf, p, chunk);
+		if (json__fwrite(json, buf, len) != len)
+			return false;
+		p += chunk;
+		n -= chunk;
+	}
+
+	return json__fputc(json, '"') != EOF;
+}
+
 /* reading */
 
 static
-char json__read_past_whitespace(json_t *json)
+int json__read_past_whitespace(json_t *json)
 {
 #if JSON_PRETTY_PRINT
 	int c;
-	while ((c = json->io.fgetc(json->user)) != EOF && isspace(c))
-		json->line += c == '\n';
+	while ((c = json__fgetc(json)) != EOF && isspace(c))
+		;
 	return c;
 #else
-	return json->io.fgetc(json->user);
+	return json__fgetc(json);
 #endif
 }
 
@@ -437,9 +1154,9 @@ void json__skip_whitespace(json_t *json)
 {
 #if JSON_PRETTY_PRINT
 	int c;
-	while ((c = json->io.fgetc(json->user)) != EOF && isspace(c))
-		json->line += c == '\n';
-	json->io.ungetc(c, json->user);
+	while ((c = json__fgetc(json)) != EOF && isspace(c))
+		;
+	json__ungetc(json, c);
 #endif
 }
 
@@ -448,7 +1165,7 @@ bool json__read_exact(json_t *json, const char *label)
 {
 	const char *p = label;
 	while (*p != 0) {
-		const char c = json->io.fgetc(json->user);
+		const char c = json__fgetc(json);
 		if (*p != c)
 			return false;
 		++p;
@@ -457,9 +1174,26 @@ bool json__read_exact(json_t *json, const char *label)
 	return true;
 }
 
+/* Matches label against the member json__peek_member has already consumed
+ * the separator & label of.  Kept out of line so that ordered reads, which
+ * never peek, pay only a predicted-not-taken test for it. */
+static JSON__NOINLINE
+bool json__read_peeked_label(json_t *json, const char *label)
+{
+	if (   !json->cur->is_array
+	    && (json->peek_long ? label != json->peek : strcmp(json->peek, label) != 0))
+		return false;
+	json->peeked = false;
+	++json->cur->n;
+	return true;
+}
+
 static
 bool json__read_label(json_t *json, const char *label)
 {
+	json->label = label;
+	if (json__unlikely(json->peeked))
+		return json__read_peeked_label(json, label);
 	if (json->cur->n > 0 && json__read_past_whitespace(json) != ',')
 		return false;
 
@@ -475,20 +1209,96 @@ bool json__read_label(json_t *json, const char *label)
 }
 
 
+static
+const char *json__view(json_t *json, size_t *len)
+{
+	return json->io.view && json__sync(json) ? json->io.view(len, json->user) : NULL;
+}
+
+static
+bool json__view_consume(json_t *json, size_t n)
+{
+#if JSON_STATS
+	json->stats.bytes_in += n;
+#endif
+	return json->io.fseek((long)n, SEEK_CUR, json->user) == 0;
+}
+
+static inline
+int json__hex_value(uint8_t c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c |= 0x20;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+/* Number of continuation bytes after lead byte c, with the range the first
+ * of them must fall in to rule out overlong forms & surrogates. */
+static
+bool json__utf8_lead(uint8_t c, uint8_t *need, uint8_t *lo, uint8_t *hi)
+{
+	*lo = 0x80;
+	*hi = 0xbf;
+	if (c >= 0xc2 && c <= 0xdf)
+		*need = 1;
+	else if (c >= 0xe0 && c <= 0xef)
+		*need = 2;
+	else if (c >= 0xf0 && c <= 0xf4)
+		*need = 3;
+	else
+		return false;
+	if (c == 0xe0)
+		*lo = 0xa0;
+	else if (c == 0xed)
+		*hi = 0x9f;
+	else if (c == 0xf0)
+		*lo = 0x90;
+	else if (c == 0xf4)
+		*hi = 0x8f;
+	return true;
+}
+
+/* Skips string content that needs no attention: printable ASCII other than
+ * '"' and '\\'. */
+static inline
+const uint8_t *json__span_plain(const uint8_t *p, const uint8_t *end)
+{
+#if defined(__SSE2__)
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i slash = _mm_set1_epi8('\\');
+	const __m128i space = _mm_set1_epi8(' ');
+	while (end - p >= 16) {
+		const __m128i b = _mm_loadu_si128((const __m128i *)p);
+		/* the signed compare flags control characters & bytes >= 0x80 alike */
+		const int m = _mm_movemask_epi8(_mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(b, quote), _mm_cmpeq_epi8(b, slash)),
+			_mm_cmplt_epi8(b, space)));
+		if (m)
+			return p + __builtin_ctz(m);
+		p += 16;
+	}
+#endif
+	while (   p < end
+	       && *p >= ' '
+	       && *p < 0x80
+	       && *p != '"'
+	       && *p != '\\')
+		++p;
+	return p;
+}
+
 static
 bool json__read_hex4(json_t *json, uint32_t *hex)
 {
 	*hex = 0;
 	for (uint32_t i = 0; i < 4; ++i) {
-		const char c = json->io.fgetc(json->user);
-		if (c >= '0' && c <= '9')
-			*hex |= (uint32_t)(c - '0' +  0) << ((4 - i - 1) * 4);
-		else if (c >= 'a' && c <= 'f')
-			*hex |= (uint32_t)(c - 'a' + 10) << ((4 - i - 1) * 4);
-		else if (c >= 'A' && c <= 'F')
-			*hex |= (uint32_t)(c - 'A' + 10) << ((4 - i - 1) * 4);
-		else
+		const int h = json__hex_value((uint8_t)json__fgetc(json));
+		if (h < 0)
 			return false;
+		*hex = *hex << 4 | (uint32_t)h;
 	}
 	return true;
 }
@@ -530,18 +1340,30 @@ bool json__hex_to_utf8(uint32_t val, char *str, size_t max, size_t *advance)
 	return false;
 }
 
+/* Decodes the digits of a \u escape, combining a surrogate pair into one
+ * code point.  Unpaired surrogates are rejected. */
 static
 bool json__read_utf8_from_hex(json_t *json, char *str, size_t max, size_t *advance)
 {
-	uint32_t hex;
-	return json__read_hex4(json, &hex)
-	    && json__hex_to_utf8(hex, str, max, advance);
+	uint32_t hex, low;
+	if (!json__read_hex4(json, &hex) || (hex >= 0xdc00 && hex <= 0xdfff))
+		return false;
+	if (hex >= 0xd800 && hex <= 0xdbff) {
+		if (   json__fgetc(json) != '\\'
+		    || json__fgetc(json) != 'u'
+		    || !json__read_hex4(json, &low)
+		    || low < 0xdc00
+		    || low > 0xdfff)
+			return false;
+		hex = 0x10000 + ((hex - 0xd800) << 10) + (low - 0xdc00);
+	}
+	return json__hex_to_utf8(hex, str, max, advance);
 }
 
 static
 bool json__read_escape(json_t *json, char *str, size_t max, size_t *advance)
 {
-	const char c = json->io.fgetc(json->user);
+	const char c = json__fgetc(json);
 	assert(max >= 1);
 	switch (c) {
 	case '"':
@@ -592,24 +1414,40 @@ bool json__read_char(json_t *json, char *str, size_t max, size_t *advance, bool
 		return false;
 	}
 
-	const char c = json->io.fgetc(json->user);
-	if (c == EOF || (c & 0xfc) == 0 || max == 0) {
+	const int c = json__fgetc(json);
+	uint8_t need, lo, hi;
+	if (c == EOF || c < ' ' || max == 0) {
 		*err = JSON__READ_STR_ERROR_DATA;
 		return false;
 	} else if (c == '"') {
 		*err = JSON__READ_STR_ERROR_NONE;
 		return false;
-	} else if (c != '\\') {
-		str[0] = c;
+	} else if (c == '\\') {
+		if (json__read_escape(json, str, max, advance)) {
+			assert(*advance < 5);
+			return true;
+		}
+	} else if (c < 0x80) {
+		str[0] = (char)c;
 		*advance = 1;
 		return true;
-	} else if (json__read_escape(json, str, max, advance)) {
-		assert(*advance < 5);
+	} else if (json__utf8_lead((uint8_t)c, &need, &lo, &hi) && max > need) {
+		/* validated as it is copied; the range only narrows for the first
+		 * continuation byte */
+		str[0] = (char)c;
+		for (uint8_t i = 1; i <= need; ++i, lo = 0x80, hi = 0xbf) {
+			const int cc = json__fgetc(json);
+			if (cc < lo || cc > hi) {
+				*err = JSON__READ_STR_ERROR_DATA;
+				return false;
+			}
+			str[i] = (char)cc;
+		}
+		*advance = need + 1;
 		return true;
-	} else {
-		*err = JSON__READ_STR_ERROR_DATA;
-		return false;
 	}
+	*err = JSON__READ_STR_ERROR_DATA;
+	return false;
 }
 
 #define JSON__READ_STR_ONCE 0
@@ -618,22 +1456,40 @@ bool json__read_char(json_t *json, char *str, size_t max, size_t *advance, bool
 static
 bool json__read_str(json_t *json, char *str, size_t max, size_t *len, bool part, int *err)
 {
-	size_t remaining = max - *len, advance;
+	size_t remaining = max - *len, advance, avail;
 	char *p = &str[*len];
 	bool success = false;
+	const bool view = json__view(json, &avail) != NULL;
 
 	if (remaining == 0) {
 		*err = JSON__READ_STR_ERROR_MORE;
 		return false;
 	}
 
-	while (json__read_char(json, p, remaining, &advance, part, err)) {
+	json__phase_begin();
+	for (;;) {
+		/* Plain ASCII is copied straight out of viewable input; anything
+		 * else goes through json__read_char one character at a time. */
+		if (view && remaining > 1) {
+			const char *src = json__view(json, &avail);
+			const size_t n = (const char *)json__span_plain((const uint8_t *)src,
+				(const uint8_t *)src + json__min(avail, remaining - 1)) - src;
+			if (n > 0) {
+				memcpy(p, src, n);
+				json__view_consume(json, n);
+				p         += n;
+				remaining -= n;
+			}
+		}
+		if (!json__read_char(json, p, remaining, &advance, part, err))
+			break;
 		p         += advance;
 		remaining -= advance;
 	}
+	json__phase_end(json, JSON_PHASE_STRING);
 
 	if (*err == JSON__READ_STR_ERROR_NONE) {
-		json->io.ungetc('"', json->user);
+		json__ungetc(json, '"');
 		if (remaining > 0) {
 			success = true;
 		} else {
@@ -655,16 +1511,16 @@ bool json__read_str(json_t *json, char *str, size_t max, size_t *len, bool part,
 static
 bool json__read_optional_char(json_t *json, const char *set, char *str, char *end, char **endptr)
 {
-	const char c = json->io.fgetc(json->user);
+	const int c = json__fgetc(json);
 	if (c == EOF || str == end) {
-		json->io.ungetc(c, json->user);
+		json__ungetc(json, c);
 		return false;
 	}
-	if (strchr(set, c)) {
+	if (c != 0 && strchr(set, c)) {
 		*str = c;
 		*endptr = str + 1;
 	} else {
-		json->io.ungetc(c, json->user);
+		json__ungetc(json, c);
 	}
 	return true;
 }
@@ -684,9 +1540,9 @@ bool json__read_optional_sign(json_t *json, char *str, char *end, char **endptr)
 static
 bool json__read_required_char(json_t *json, const char *set, char *str, char *end, char **endptr)
 {
-	const char c = json->io.fgetc(json->user);
-	if (c == EOF || strchr(set, c) == NULL || str == end) {
-		json->io.ungetc(c, json->user);
+	const int c = json__fgetc(json);
+	if (c == EOF || c == 0 || strchr(set, c) == NULL || str == end) {
+		json__ungetc(json, c);
 		return false;
 	}
 	*str = c;
@@ -746,12 +1602,12 @@ static
 bool json__read_digits(json_t *json, char *str, char *end, char **endptr)
 {
 	char *p = str;
-	char c;
-	while (   (c = json->io.fgetc(json->user)) != EOF
-	       && isdigit(c)
+	int c;
+	while (   (c = json__fgetc(json)) >= '0'
+	       && c <= '9'
 	       && p != end)
-		*p++ = c;
-	json->io.ungetc(c, json->user);
+		*p++ = (char)c;
+	json__ungetc(json, c);
 	if (p > str && p < end) {
 		*endptr = p;
 		return true;
@@ -759,6 +1615,24 @@ bool json__read_digits(json_t *json, char *str, char *end, char **endptr)
 	return false;
 }
 
+/* The integer part of a number: JSON allows no leading zeros. */
+static
+bool json__read_int_digits(json_t *json, char *str, char *end, char **endptr)
+{
+	return json__read_digits(json, str, end, endptr)
+	    && (str[0] != '0' || *endptr - str == 1);
+}
+
+/* After the digits of an integer read: a fraction or exponent means the
+ * number isn't one, rather than one followed by ".5" or "e2". */
+static
+bool json__read_int_end(json_t *json)
+{
+	const int c = json__fgetc(json);
+	json__ungetc(json, c);
+	return c != '.' && c != 'e' && c != 'E';
+}
+
 bool json_read_member_label(json_t *json, const char *label)
 {
 	return json__read_label(json, label);
@@ -769,14 +1643,18 @@ bool json_read_object_begin(json_t *json, const char *label, json_obj_t *obj)
 	if (!json__read_label(json, label))
 		return false;
 
-	json__push_obj(json, obj, false);
+	json__push_obj(json, obj, label, false);
 
-	return json__read_past_whitespace(json) == '{';
+	if (json__read_past_whitespace(json) != '{')
+		return false;
+	json__opened(json);
+	return true;
 }
 
 bool json_read_object_end(json_t *json)
 {
 	assert(json->indent > 0);
+	json__trace(json, json->cur->label, false, false);
 	json->cur = json->cur->prev;
 	--json->indent;
 	return json__read_past_whitespace(json) == '}';
@@ -787,13 +1665,17 @@ bool json_read_array_begin(json_t *json, const char *label, json_obj_t *obj)
 	if (!json__read_label(json, label))
 		return false;
 
-	json__push_obj(json, obj, true);
+	json__push_obj(json, obj, label, true);
 
-	return json__read_past_whitespace(json) == '[';
+	if (json__read_past_whitespace(json) != '[')
+		return false;
+	json__opened(json);
+	return true;
 }
 
 bool json_read_array_end(json_t *json)
 {
+	json__trace(json, json->cur->label, true, false);
 	json->cur = json->cur->prev;
 	--json->indent;
 	return json__read_past_whitespace(json) == ']';
@@ -801,11 +1683,13 @@ bool json_read_array_end(json_t *json)
 
 bool json_read_null(json_t *json, const char *label)
 {
-	if (!json__read_label(json, label))
+	if (   !json__read_label(json, label)
+	    || json__read_past_whitespace(json) != 'n'
+	    || !json__read_exact(json, "ull"))
 		return false;
 
-	const char c = json__read_past_whitespace(json);
-	return c == 'n' && json__read_exact(json, "ull");
+	json__count_value(json, JSON_TYPE_NULL);
+	return true;
 }
 
 bool json_read_bool(json_t *json, const char *label, bool *val)
@@ -816,11 +1700,13 @@ bool json_read_bool(json_t *json, const char *label, bool *val)
 	switch (json__read_past_whitespace(json)) {
 	case 't':
 		if (json__read_exact(json, "rue")) {
+			json__count_value(json, JSON_TYPE_BOOL);
 			*val = true;
 			return true;
 		}
 	case 'f':
 		if (json__read_exact(json, "alse")) {
+			json__count_value(json, JSON_TYPE_BOOL);
 			*val = false;
 			return true;
 		}
@@ -909,13 +1795,11 @@ bool json__read_decimal_number_string(json_t *json, const char *label, char str[
 	if (inf_or_nan_found)
 		goto out;
 
-	if (!json__read_digits(json, p, end, &p))
+	if (!json__read_int_digits(json, p, end, &p))
 		return false;
 
-	if (!json__read_decimal(json, p, end, &p))
-		goto out;
-
-	if (!json__read_digits(json, p, end, &p))
+	if (   json__read_decimal(json, p, end, &p)
+	    && !json__read_digits(json, p, end, &p))
 		return false;
 
 	if (!json__read_exponent_symbol(json, p, end, &p))
@@ -928,6 +1812,7 @@ bool json__read_decimal_number_string(json_t *json, const char *label, char str[
 		return false;
 
 out:
+	json__count_value(json, JSON_TYPE_NUMBER);
 	return true;
 }
 
@@ -935,12 +1820,29 @@ bool json_read_float(json_t *json, const char *label, float *val)
 {
 	char str[64] = {0};
 	if (json__read_decimal_number_string(json, label, str)) {
+		json__phase_begin();
 		*val = strtof(str, NULL);
+		json__phase_end(json, JSON_PHASE_NUMBER);
 		return true;
 	}
 	return false;
 }
 
+/* Converts the digits json__read_int_digits collected; false above `max`. */
+static
+bool json__parse_u64(const char *s, uint64_t max, uint64_t *val)
+{
+	uint64_t v = 0;
+	for (; *s; ++s) {
+		const unsigned d = (unsigned)(*s - '0');
+		if (v > (max - d) / 10)
+			return false;
+		v = v * 10 + d;
+	}
+	*val = v;
+	return true;
+}
+
 bool json_read_int64(json_t *json, const char *label, int64_t *val)
 {
 	/* 20 digits can hold 2^64-1, so 32 is plenty */
@@ -956,11 +1858,20 @@ bool json_read_int64(json_t *json, const char *label, int64_t *val)
 	if (!json__read_optional_negative(json, p, end, &p))
 		return false;
 
-	if (!json__read_digits(json, p, end, &p))
+	if (   !json__read_int_digits(json, p, end, &p)
+	    || !json__read_int_end(json))
 		return false;
 
-	*val = strtoll(str, NULL, 10);
-	return true;
+	json__phase_begin();
+	const bool neg = str[0] == '-';
+	uint64_t u;
+	const bool ok = json__parse_u64(str + neg, neg ? (uint64_t)INT64_MAX + 1 : INT64_MAX, &u);
+	if (ok) {
+		*val = neg ? (int64_t)(0 - u) : (int64_t)u;
+		json__count_value(json, JSON_TYPE_NUMBER);
+	}
+	json__phase_end(json, JSON_PHASE_NUMBER);
+	return ok;
 }
 
 bool json_read_uint64(json_t *json, const char *label, uint64_t *val)
@@ -975,10 +1886,50 @@ bool json_read_uint64(json_t *json, const char *label, uint64_t *val)
 
 	json__skip_whitespace(json);
 
-	if (!json__read_digits(json, p, end, &p))
+	if (   !json__read_int_digits(json, p, end, &p)
+	    || !json__read_int_end(json))
 		return false;
 
-	*val = strtoull(str, NULL, 10);
+	json__phase_begin();
+	const bool ok = json__parse_u64(str, UINT64_MAX, val);
+	if (ok)
+		json__count_value(json, JSON_TYPE_NUMBER);
+	json__phase_end(json, JSON_PHASE_NUMBER);
+	return ok;
+}
+
+/* Clinger's fast path: with at most 15 significant digits and a power of ten
+ * a double holds exactly, one multiply or divide gives the correctly rounded
+ * result strtod would.  That covers what the fixed precisions write. */
+static
+bool json__strtod_fast(const char *s, double *val)
+{
+	const bool neg = *s == '-';
+	uint64_t m = 0;
+	int digits = 0, exp10 = 0;
+	s += neg;
+	for (; *s >= '0' && *s <= '9'; ++s) {
+		digits += digits > 0 || *s != '0';
+		m = m * 10 + (uint64_t)(*s - '0');
+	}
+	if (*s == '.') {
+		for (++s; *s >= '0' && *s <= '9'; ++s, --exp10) {
+			digits += digits > 0 || *s != '0';
+			m = m * 10 + (uint64_t)(*s - '0');
+		}
+	}
+	if (*s == 'e' || *s == 'E') {
+		const bool eneg = *++s == '-';
+		int e = 0;
+		s += *s == '-' || *s == '+';
+		for (; *s >= '0' && *s <= '9' && e < 1000; ++s)
+			e = e * 10 + (*s - '0');
+		exp10 += eneg ? -e : e;
+	}
+	if (*s != 0 || digits > 15 || exp10 < -22 || exp10 > 22)
+		return false;
+	const double d = exp10 < 0 ? (double)m / json__pow10[-exp10] : (double)m * json__pow10[exp10];
+	*val = neg ? -d : d;
 	return true;
 }
 
@@ -986,7 +1937,10 @@ bool json_read_double(json_t *json, const char *label, double *val)
 {
 	char str[64] = {0};
 	if (json__read_decimal_number_string(json, label, str)) {
-		*val = strtod(str, NULL);
+		json__phase_begin();
+		if (!json__strtod_fast(str, val))
+			*val = strtod(str, NULL);
+		json__phase_end(json, JSON_PHASE_NUMBER);
 		return true;
 	}
 	return false;
@@ -1004,18 +1958,63 @@ bool json_read_str(json_t *json, const char *label, char *val, size_t max)
 {
 	size_t len = 0;
 	int err;
-	return json__read_label(json, label)
-	    && json__read_past_whitespace(json) == '"'
-	    && json__read_str(json, val, max, &len, JSON__READ_STR_ONCE, &err)
-	    && json->io.fgetc(json->user) == '"';
+	if (   !json__read_label(json, label)
+	    || json__read_past_whitespace(json) != '"'
+	    || !json__read_str(json, val, max, &len, JSON__READ_STR_ONCE, &err)
+	    || json__fgetc(json) != '"')
+		return false;
+	json__count_value(json, JSON_TYPE_STRING);
+	return true;
+}
+
+bool json_read_str_alloc(json_t *json, const char *label, char **val, size_t *len)
+{
+	json_arena_t *arena = json->arena;
+	int err;
+
+	assert(arena);
+	*len = 0;
+
+	/* Read straight into the free tail of the arena and only claim what the
+	 * string turned out to need. */
+	if (   !json__read_label(json, label)
+	    || json__read_past_whitespace(json) != '"'
+	    || !json__read_str(json, &arena->buf[arena->pos], arena->len - arena->pos,
+	                       len, JSON__READ_STR_ONCE, &err)
+	    || json__fgetc(json) != '"')
+		return false;
+
+	*val = &arena->buf[arena->pos];
+	arena->pos += *len + 1;
+	json__count_value(json, JSON_TYPE_STRING);
+	return true;
+}
+
+bool json_read_array_alloc(json_t *json, const char *label, json_obj_t *obj,
+                           size_t n, size_t size, size_t align, void **items)
+{
+	assert(json->arena);
+	const size_t pos = json->arena->pos;
+
+	if (n > 0 && size > SIZE_MAX / n)
+		return false;
+	if (   (*items = json_arena_alloc(json->arena, n * size, align)) == NULL
+	    || !json_read_array_begin(json, label, obj)) {
+		json->arena->pos = pos;
+		return false;
+	}
+	return true;
 }
 
 bool json_read_strn(json_t *json, const char *label, char *val, size_t n)
 {
-	return json__read_label(json, label)
-	    && json__read_past_whitespace(json) == '"'
-	    && json->io.fread(val, 1, n, json->user) == n
-	    && json->io.fgetc(json->user) == '"';
+	if (   !json__read_label(json, label)
+	    || json__read_past_whitespace(json) != '"'
+	    || json__fread(json, val, n) != n
+	    || json__fgetc(json) != '"')
+		return false;
+	json__count_value(json, JSON_TYPE_STRING);
+	return true;
 }
 
 bool json_read_str_part(json_t *json, const char *label, char *val, size_t max, size_t *len, bool *more)
@@ -1028,7 +2027,10 @@ bool json_read_str_part(json_t *json, const char *label, char *val, size_t max,
 
 	if (json__read_str(json, val, max, len, JSON__READ_STR_PART, &err)) {
 		*more = false;
-		return json->io.fgetc(json->user) == '"';
+		if (json__fgetc(json) != '"')
+			return false;
+		json__count_value(json, JSON_TYPE_STRING);
+		return true;
 	} else if (err == JSON__READ_STR_ERROR_DATA) {
 		return false;
 	} else if (err == JSON__READ_STR_ERROR_MORE) {
@@ -1040,16 +2042,2250 @@ bool json_read_str_part(json_t *json, const char *label, char *val, size_t max,
 	}
 }
 
+static
+bool json__read_blob(json_t *json, uint8_t *dst, size_t max, size_t *len, bool part, bool *more)
+{
+	char buf[JSON__BLOB_CHUNK * 4];
+
+	for (;;) {
+		/* Only pull whole quanta that are guaranteed to fit, so nothing
+		 * has to be carried over to the next call. */
+		const size_t quanta = json__min((max - *len) / 3, JSON__BLOB_CHUNK);
+		size_t n = 0, decoded;
+		int c = 0;
+
+		while (n < quanta * 4 && (c = json__fgetc(json)) != '"' && c != EOF)
+			buf[n++] = (char)c;
+		/* padding is only valid right before the closing quote */
+		if (c != '"' && c != EOF && (c = json__fgetc(json)) != '"')
+			json__ungetc(json, c);
+
+		if (c == EOF || !json__b64_decode(&dst[*len], buf, n, c == '"', &decoded))
+			return false;
+		*len += decoded;
+
+		if (c == '"') {
+			*more = false;
+			return true;
+		} else if (quanta == JSON__BLOB_CHUNK) {
+			continue;
+		}
+
+		/* Out of room.  A whole read sized with json_blob_decoded_size can
+		 * still end in a padded quantum that fits in the last 1-2 bytes,
+		 * which is checked before a part read asks for more. */
+		uint8_t tail[3];
+		buf[0] = (char)(c = json__fgetc(json));
+		for (n = 1; n < 4 && c != EOF; ++n)
+			buf[n] = (char)(c = json__fgetc(json));
+		if (c == EOF || !json__b64_decode(tail, buf, 4, true, &decoded))
+			return false;
+		if (decoded <= max - *len) {
+			if ((c = json__fgetc(json)) == '"') {
+				memcpy(&dst[*len], tail, decoded);
+				*len += decoded;
+				*more = false;
+				return true;
+			}
+			json__ungetc(json, c);
+		}
+		if (!part)
+			return false;
+
+		/* Not the last quantum: hand it back for a call with more room. */
+		while (n > 0)
+			json__ungetc(json, buf[--n]);
+		*more = true;
+		return true;
+	}
+}
+
+bool json_read_blob(json_t *json, const char *label, void *data, size_t max, size_t *len)
+{
+	bool more = false;
+	*len = 0;
+	if (   !json__read_label(json, label)
+	    || json__read_past_whitespace(json) != '"'
+	    || !json__read_blob(json, data, max, len, false, &more))
+		return false;
+	json__count_value(json, JSON_TYPE_STRING);
+	return true;
+}
+
+bool json_read_blob_part(json_t *json, const char *label, void *data, size_t max, size_t *len, bool *more)
+{
+	// first iteration
+	if (!*more && (!json__read_label(json, label) || json__read_past_whitespace(json) != '"'))
+		return false;
+
+	const bool ok = json__read_blob(json, data, max, len, true, more);
+	if (ok && !*more)
+		json__count_value(json, JSON_TYPE_STRING);
+	return ok;
+}
+
 bool json_peek_array_end(json_t *json)
 {
-	char c = json__read_past_whitespace(json);
-	json->io.ungetc(c, json->user);
+	if (json->peeked)
+		return false;
+	const int c = json__read_past_whitespace(json);
+	json__ungetc(json, c);
 	return c == ']';
 }
 
 bool json_peek_data_end(json_t *json)
 {
-	char c = json__read_past_whitespace(json);
-	json->io.ungetc(c, json->user);
+	if (json->peeked)
+		return false;
+	const int c = json__read_past_whitespace(json);
+	json__ungetc(json, c);
 	return c == EOF;
 }
+
+static int json__digest_fgetc(void *user);
+
+/* CRC of what a json_init_digest reader has consumed, i.e. without the bytes
+ * fetched into the lookahead. */
+static
+uint32_t json__digest_crc(const json_t *json)
+{
+	const json_digest_t *d = json->user;
+	return json->nahead == 0 ? d->crc : d->hist[(d->pos - json->nahead) % JSON_LOOKAHEAD];
+}
+
+/* Consumes the separator & label of the next member up front, leaving the
+ * label in json->peek until the member is read.  False at the end of the
+ * enclosing object/array. */
+static
+bool json__peek_member(json_t *json)
+{
+	size_t len = 0;
+	int c;
+
+	if (json->peeked)
+		return true;
+
+	/* json_read_digest covers what came before the member peeked here */
+	if (json->io.fgetc == json__digest_fgetc)
+		((json_digest_t *)json->user)->peek_crc = json__digest_crc(json);
+
+	c = json__read_past_whitespace(json);
+	if (c == '}' || c == ']' || c == EOF) {
+		json__ungetc(json, c);
+		return false;
+	}
+	if (json->cur->n > 0) {
+		if (c != ',')
+			return false;
+		c = json__read_past_whitespace(json);
+	}
+
+	json->peek_long = false;
+	if (json->cur->is_array) {
+		json__ungetc(json, c);
+	} else {
+		if (c != '"')
+			return false;
+		while ((c = json__fgetc(json)) != '"') {
+			if (c == EOF || c == '\\')
+				return false;
+			/* the rest of an overlong label is consumed but not kept */
+			if (len + 1 == sizeof(json->peek))
+				json->peek_long = true;
+			else
+				json->peek[len++] = (char)c;
+		}
+		if (json__read_past_whitespace(json) != ':')
+			return false;
+	}
+	json->peek[len] = 0;
+	json->peeked = true;
+	return true;
+}
+
+const char *json_peek_label(json_t *json)
+{
+	return json__peek_member(json) ? json->peek : NULL;
+}
+
+json_type_t json_peek_type(json_t *json)
+{
+	json_type_t type = JSON_TYPE_COUNT;
+	int c, c2;
+
+	if (!json__peek_member(json))
+		return JSON_TYPE_COUNT;
+
+	switch (c = json__read_past_whitespace(json)) {
+	case '{': type = JSON_TYPE_OBJECT; break;
+	case '[': type = JSON_TYPE_ARRAY;  break;
+	case '"': type = JSON_TYPE_STRING; break;
+	case 't':
+	case 'f': type = JSON_TYPE_BOOL;   break;
+	case 'n':
+		/* null, or the nan json_write_double can produce */
+		c2 = json__fgetc(json);
+		type = c2 == 'a' ? JSON_TYPE_NUMBER : JSON_TYPE_NULL;
+		json__ungetc(json, c2);
+		break;
+	default:
+		if (c == '-' || c == 'i' || (c >= '0' && c <= '9'))
+			type = JSON_TYPE_NUMBER;
+		break;
+	}
+	json__ungetc(json, c);
+	return type;
+}
+
+/* raw values */
+
+/* Length of the string starting at the opening quote in p, including both
+ * quotes, or 0 if it is unterminated. */
+static
+size_t json__span_str(const char *p, const char *end)
+{
+	const char *q = p + 1;
+	while ((q = memchr(q, '"', end - q)) != NULL) {
+		/* An odd run of backslashes means the quote is escaped. */
+		const char *b = q;
+		while (b > p + 1 && b[-1] == '\\')
+			--b;
+		if ((q - b) % 2 == 0)
+			return q + 1 - p;
+		++q;
+	}
+	return 0;
+}
+
+/* Length of the value starting at p, or 0 if it is malformed or runs past
+ * end.  Only the nesting & string structure is checked. */
+static
+size_t json__span_value(const char *p, const char *end)
+{
+	const char *q = p;
+	size_t depth = 0, n;
+
+	if (p == end)
+		return 0;
+
+	do {
+		switch (*q) {
+		case '"':
+			if ((n = json__span_str(q, end)) == 0)
+				return 0;
+			q += n;
+			break;
+		case '{':
+		case '[':
+			++depth;
+			++q;
+			break;
+		case '}':
+		case ']':
+			if (depth == 0)
+				return 0;
+			--depth;
+			++q;
+			break;
+		default:
+			if (depth == 0) {
+				while (q != end && !strchr(",}] \t\r\n", *q))
+					++q;
+			} else {
+				++q;
+			}
+			break;
+		}
+	} while (depth > 0 && q != end);
+
+	return depth == 0 && q > p ? (size_t)(q - p) : 0;
+}
+
+/* Locates the next value in a viewable backend and consumes it. */
+static
+bool json__read_raw_view(json_t *json, const char *view, size_t avail, const char **value, size_t *len)
+{
+	const char *p = view, *end = view + avail;
+
+#if JSON_PRETTY_PRINT
+	while (p != end && isspace((unsigned char)*p))
+		++p;
+#endif
+
+	*value = p;
+	*len = json__span_value(p, end);
+	return *len > 0 && json__view_consume(json, (p - view) + *len);
+}
+
+static
+bool json__raw_put(char *buf, size_t max, size_t *len, int c)
+{
+	if (buf) {
+		if (*len + 1 >= max)
+			return false;
+		buf[*len] = (char)c;
+	}
+	++*len;
+	return true;
+}
+
+/* Incremental form of json__span_value for input that arrives in pieces. */
+typedef struct json__scan
+{
+	size_t depth;
+	bool in_str, escape;
+} json__scan_t;
+
+/* Returns how many bytes of p belong to the value and sets *done once it is
+ * complete.  A scalar's terminating delimiter is not part of the value. */
+static
+size_t json__scan(json__scan_t *s, const char *p, size_t n, bool *done)
+{
+	for (size_t i = 0; i < n; ++i) {
+		const char c = p[i];
+		if (s->in_str) {
+			if (s->escape) {
+				s->escape = false;
+			} else if (c == '\\') {
+				s->escape = true;
+			} else if (c == '"') {
+				s->in_str = false;
+				if (s->depth == 0) {
+					*done = true;
+					return i + 1;
+				}
+			}
+		} else if (c == '"') {
+			s->in_str = true;
+		} else if (c == '{' || c == '[') {
+			++s->depth;
+		} else if (c == '}' || c == ']') {
+			if (s->depth == 0) {
+				*done = true;
+				return i;
+			}
+			if (--s->depth == 0) {
+				*done = true;
+				return i + 1;
+			}
+		} else if (s->depth == 0 && strchr(", \t\r\n", c)) {
+			*done = true;
+			return i;
+		}
+	}
+	*done = false;
+	return n;
+}
+
+/* Streams the next value into buf (when non-NULL) one byte at a time. */
+static
+bool json__read_raw_stream(json_t *json, char *buf, size_t max, size_t *len)
+{
+	json__scan_t s = { 0 };
+	bool done = false;
+	int c;
+
+	*len = 0;
+	json__skip_whitespace(json);
+
+	while (!done && (c = json__fgetc(json)) != EOF) {
+		const char ch = (char)c;
+		if (json__scan(&s, &ch, 1, &done) == 0) {
+			json__ungetc(json, c);
+			break;
+		}
+		if (!json__raw_put(buf, max, len, c))
+			return false;
+	}
+
+	/* a scalar may also be terminated by the end of the input */
+	return *len > 0 && s.depth == 0 && !s.in_str;
+}
+
+/* Skips the next value in blocks, seeking back over whatever was read past
+ * its end. */
+static
+bool json__skip_seekable(json_t *json)
+{
+	char buf[4096];
+	json__scan_t s = { 0 };
+	bool done = false;
+	size_t total = 0;
+
+	json__skip_whitespace(json);
+	if (!json__sync(json))
+		return false;
+
+	while (!done) {
+		const size_t got = json__fread(json, buf, sizeof(buf));
+		if (got == 0)
+			break;
+		const size_t used = json__scan(&s, buf, got, &done);
+		total += used;
+		if (done) {
+#if JSON_STATS
+			json->stats.bytes_in -= got - used;
+#endif
+			if (json->io.fseek(-(long)(got - used), SEEK_CUR, json->user) != 0)
+				return false;
+		}
+	}
+
+	return total > 0 && s.depth == 0 && !s.in_str;
+}
+
+static
+bool json__skip(json_t *json)
+{
+	const char *view, *value;
+	size_t avail, len;
+
+	if ((view = json__view(json, &avail)) != NULL)
+		return json__read_raw_view(json, view, avail, &value, &len);
+	if (json->io.fseek && json->io.fread)
+		return json__skip_seekable(json);
+	return json__read_raw_stream(json, NULL, 0, &len);
+}
+
+bool json_read_raw_value(json_t *json, const char *label, char *buf, size_t max, size_t *len)
+{
+	const char *view, *value;
+	size_t avail;
+
+	if (!json__read_label(json, label))
+		return false;
+
+	if ((view = json__view(json, &avail)) != NULL) {
+		if (!json__read_raw_view(json, view, avail, &value, len) || *len >= max)
+			return false;
+		memcpy(buf, value, *len);
+	} else if (!json__read_raw_stream(json, buf, max, len)) {
+		return false;
+	}
+
+	buf[*len] = 0;
+	return true;
+}
+
+bool json_read_raw_value_ref(json_t *json, const char *label, const char **value, size_t *len)
+{
+	const char *view;
+	size_t avail;
+
+	/* Check before consuming the label so callers can fall back to a copy. */
+	return json__view(json, &avail) != NULL
+	    && json__read_label(json, label)
+	    && (view = json__view(json, &avail)) != NULL
+	    && json__read_raw_view(json, view, avail, value, len);
+}
+
+bool json_skip_value(json_t *json, const char *label)
+{
+	return json__read_label(json, label)
+	    && json__skip(json);
+}
+
+bool json_read_defer(json_t *json, const char *label, json_defer_t *defer)
+{
+	long offset;
+	int c;
+
+	if (   !json->io.ftell
+	    || !json__read_label(json, label))
+		return false;
+
+	json__skip_whitespace(json);
+	if (   !json__sync(json)
+	    || (offset = json->io.ftell(json->user)) < 0
+	    || ((c = json__fgetc(json)) != '{' && c != '['))
+		return false;
+	json__ungetc(json, c);
+
+	defer->offset = offset;
+	defer->depth = json->indent;
+	defer->label = label;
+	defer->is_array = c == '[';
+	return json__skip(json);
+}
+
+bool json_read_resume(json_t *json, json_io_t io, void *user, const json_defer_t *defer)
+{
+	json_init(json, io, user);
+	json->indent = defer->depth;
+	return io.fseek
+	    && io.fseek(defer->offset, SEEK_SET, user) == 0;
+}
+
+/* tolerant reading */
+
+static
+uint32_t json__label_hash(const char *label, uint32_t seed)
+{
+	uint32_t h = 2166136261u ^ (seed * 0x9e3779b1u);
+	for (; *label; ++label)
+		h = (h ^ (uint8_t)*label) * 16777619u;
+	return h ^ (h >> 16);
+}
+
+bool json_labels_init(json_labels_t *labels, const json_member_t *members, size_t n)
+{
+	uint32_t size = 8;
+
+	if (n > JSON_MEMBERS_MAX)
+		return false;
+	for (size_t i = 0; i < n; ++i)
+		if (strlen(members[i].label) >= JSON_LABEL_MAX)
+			return false;
+	/* at 1/8 load a collision-free seed turns up within a few hundred tries */
+	while (size < n * 8)
+		size *= 2;
+	labels->members = members;
+	labels->n = n;
+	labels->mask = size - 1;
+	for (uint32_t seed = 0; seed < 100000; ++seed) {
+		size_t i = 0;
+		memset(labels->slots, 0xff, sizeof(labels->slots));
+		for (; i < n; ++i) {
+			uint8_t *slot = &labels->slots[json__label_hash(members[i].label, seed) & labels->mask];
+			if (*slot != 0xff) {
+				if (strcmp(members[*slot].label, members[i].label) == 0)
+					return false;
+				break;
+			}
+			*slot = (uint8_t)i;
+		}
+		if (i == n) {
+			labels->seed = seed;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool json_read_member_index(json_t *json, const json_labels_t *labels, size_t *index)
+{
+	const char *label = json_peek_label(json);
+	if (label == NULL)
+		return false;
+	const uint8_t i = labels->slots[json__label_hash(label, labels->seed) & labels->mask];
+	/* one compare to tell a member from an unknown label that hashed onto it */
+	*index =    i != 0xff
+	         && !json->peek_long
+	         && strcmp(labels->members[i].label, label) == 0 ? i : labels->n;
+	return true;
+}
+
+bool json_read_members(json_t *json, const char *label, const json_labels_t *labels, void *user,
+                       uint64_t *seen)
+{
+	json_obj_t obj;
+	json_obj_t *const cur = json->cur;
+	const size_t indent = json->indent;
+	size_t i;
+
+	if (seen)
+		*seen = 0;
+	if (!json_read_object_begin(json, label, &obj))
+		return json__unwind(json, cur, indent);
+	while (json_read_member_index(json, labels, &i)) {
+		if (i == labels->n) {
+			if (!json_skip_value(json, json->peek))
+				return json__unwind(json, cur, indent);
+			continue;
+		}
+		if (!labels->members[i].read(json, labels->members[i].label, user))
+			return json__unwind(json, cur, indent);
+		if (seen)
+			*seen |= (uint64_t)1 << i;
+	}
+	/* a malformed member also ends the loop, & fails here */
+	return json_read_object_end(json) || json__unwind(json, cur, indent);
+}
+
+/* columns */
+
+static
+bool json__write_cell(json_t *json, const char *label, json_column_type_t type, const void *p)
+{
+	switch (type) {
+	case JSON_COLUMN_BOOL:   return json_write_bool(json, label, *(const bool *)p);
+	case JSON_COLUMN_INT8:   return json__write_int(json, label, *(const int8_t *)p);
+	case JSON_COLUMN_UINT8:  return json__write_uint(json, label, *(const uint8_t *)p);
+	case JSON_COLUMN_INT16:  return json__write_int(json, label, *(const int16_t *)p);
+	case JSON_COLUMN_UINT16: return json__write_uint(json, label, *(const uint16_t *)p);
+	case JSON_COLUMN_INT32:  return json__write_int(json, label, *(const int32_t *)p);
+	case JSON_COLUMN_UINT32: return json__write_uint(json, label, *(const uint32_t *)p);
+	case JSON_COLUMN_INT64:  return json__write_int(json, label, *(const int64_t *)p);
+	case JSON_COLUMN_UINT64: return json__write_uint(json, label, *(const uint64_t *)p);
+	case JSON_COLUMN_FLOAT:  return json_write_float(json, label, *(const float *)p);
+	case JSON_COLUMN_DOUBLE: return json_write_double(json, label, *(const double *)p);
+	}
+	return false;
+}
+
+static
+bool json__read_cell(json_t *json, const char *label, json_column_type_t type, void *p)
+{
+	switch (type) {
+	case JSON_COLUMN_BOOL:   return json_read_bool(json, label, p);
+	case JSON_COLUMN_INT8:   return json_read_int8(json, label, p);
+	case JSON_COLUMN_UINT8:  return json_read_uint8(json, label, p);
+	case JSON_COLUMN_INT16:  return json_read_int16(json, label, p);
+	case JSON_COLUMN_UINT16: return json_read_uint16(json, label, p);
+	case JSON_COLUMN_INT32:  return json_read_int32(json, label, p);
+	case JSON_COLUMN_UINT32: return json_read_uint32(json, label, p);
+	case JSON_COLUMN_INT64:  return json_read_int64(json, label, p);
+	case JSON_COLUMN_UINT64: return json_read_uint64(json, label, p);
+	case JSON_COLUMN_FLOAT:  return json_read_float(json, label, p);
+	case JSON_COLUMN_DOUBLE: return json_read_double(json, label, p);
+	}
+	return false;
+}
+
+bool json_write_columns(json_t *json, const char *label, const void *records, size_t n,
+                        size_t stride, const json_column_t *cols, size_t ncols)
+{
+	json_obj_t obj, arr;
+	json_obj_t *const cur = json->cur;
+	const size_t indent = json->indent;
+
+	if (!json_write_object_begin(json, label, &obj))
+		return json__unwind(json, cur, indent);
+	for (size_t c = 0; c < ncols; ++c) {
+		const char *p = (const char *)records + cols[c].offset;
+		if (!json_write_array_begin(json, cols[c].label, &arr))
+			return json__unwind(json, cur, indent);
+		for (size_t i = 0; i < n; ++i, p += stride)
+			if (!json__write_cell(json, "", cols[c].type, p))
+				return json__unwind(json, cur, indent);
+		if (!json_write_array_end(json))
+			return json__unwind(json, cur, indent);
+	}
+	return json_write_object_end(json) || json__unwind(json, cur, indent);
+}
+
+bool json_read_columns(json_t *json, const char *label, void *records, size_t max, size_t *n,
+                       size_t stride, const json_column_t *cols, size_t ncols)
+{
+	json_obj_t obj, arr;
+	json_obj_t *const cur = json->cur;
+	const size_t indent = json->indent;
+
+	*n = 0;
+	if (!json_read_object_begin(json, label, &obj))
+		return json__unwind(json, cur, indent);
+	for (size_t c = 0; c < ncols; ++c) {
+		char *p = (char *)records + cols[c].offset;
+		size_t i = 0;
+		if (!json_read_array_begin(json, cols[c].label, &arr))
+			return json__unwind(json, cur, indent);
+		for (; !json_peek_array_end(json); ++i, p += stride)
+			if (i == max || !json__read_cell(json, "", cols[c].type, p))
+				return json__unwind(json, cur, indent);
+		if (!json_read_array_end(json) || (c > 0 && i != *n))
+			return json__unwind(json, cur, indent);
+		*n = i;
+	}
+	return json_read_object_end(json) || json__unwind(json, cur, indent);
+}
+
+/* Delta form: values quantized to origin + scale * q, with q stored as the
+ * differences between neighbours, so a polyline of nearby points becomes a
+ * run of small integers.  Quantizing the values rather than the deltas
+ * keeps rounding from accumulating along the array. */
+/* A finite origin & a positive, finite scale; false for nan too. */
+static
+bool json__delta_header_ok(double origin, double scale)
+{
+	return origin >= -DBL_MAX && origin <= DBL_MAX && scale > 0 && scale <= DBL_MAX;
+}
+
+bool json_write_delta_array(json_t *json, const char *label, const double *vals, size_t n,
+                            size_t stride, double origin, double scale)
+{
+	json_obj_t obj, arr;
+	json_obj_t *const cur = json->cur;
+	const size_t indent = json->indent;
+	const char *p = (const char *)vals;
+	int64_t prev = 0;
+
+	/* the header is written exactly whatever json_set_precision says, as
+	 * every value is rebuilt from it */
+	if (   !json__delta_header_ok(origin, scale)
+	    || !json_write_object_begin(json, label, &obj)
+	    || !json_write_double_prec(json, "origin", origin, JSON_PRECISION_EXACT, 0)
+	    || !json_write_double_prec(json, "scale", scale, JSON_PRECISION_EXACT, 0)
+	    || !json_write_uint64(json, "n", n)
+	    || !json_write_array_begin(json, "deltas", &arr))
+		return json__unwind(json, cur, indent);
+	for (size_t i = 0; i < n; ++i, p += stride) {
+		const double x = (*(const double *)p - origin) / scale;
+		/* also false for nan */
+		if (!(x > -9e18 && x < 9e18))
+			return json__unwind(json, cur, indent);
+		const int64_t q = (int64_t)(x < 0 ? x - 0.5 : x + 0.5);
+		/* wraps like the reader's sum, should the values span over 2^63 */
+		if (!json__write_int(json, "", (int64_t)((uint64_t)q - (uint64_t)prev)))
+			return json__unwind(json, cur, indent);
+		prev = q;
+	}
+	return (json_write_array_end(json) && json_write_object_end(json))
+	    || json__unwind(json, cur, indent);
+}
+
+bool json_read_delta_array(json_t *json, const char *label, double *vals, size_t max, size_t *n,
+                           size_t stride)
+{
+	json_obj_t obj, arr;
+	json_obj_t *const cur = json->cur;
+	const size_t indent = json->indent;
+	char *p = (char *)vals;
+	double origin, scale;
+	uint64_t count;
+	int64_t d;
+	/* unsigned so that a corrupt input wraps instead of overflowing */
+	uint64_t q = 0;
+
+	*n = 0;
+	if (   !json_read_object_begin(json, label, &obj)
+	    || !json_read_double(json, "origin", &origin)
+	    || !json_read_double(json, "scale", &scale)
+	    || !json__delta_header_ok(origin, scale)
+	    || !json_read_uint64(json, "n", &count)
+	    || count > max
+	    || !json_read_array_begin(json, "deltas", &arr))
+		return json__unwind(json, cur, indent);
+	/* the running sum is one add next to each integer parse, so it is folded
+	 * into the read loop instead of taking a separate pass */
+	for (size_t i = 0; i < count; ++i, p += stride) {
+		if (!json_read_int64(json, "", &d))
+			return json__unwind(json, cur, indent);
+		q += (uint64_t)d;
+		*(double *)p = origin + scale * (double)(int64_t)q;
+	}
+	*n = (size_t)count;
+	return (json_read_array_end(json) && json_read_object_end(json))
+	    || json__unwind(json, cur, indent);
+}
+
+/* digest */
+
+#if !(defined(__SSE4_2__) && defined(__x86_64__))
+static const uint32_t g_json_crc32c[256] = {
+	0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c, 0x26a1e7e8, 0xd4ca64eb,
+	0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b, 0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24,
+	0x105ec76f, 0xe235446c, 0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+	0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc, 0xbc267848, 0x4e4dfb4b,
+	0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a, 0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35,
+	0xaa64d611, 0x580f5512, 0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+	0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad, 0x1642ae59, 0xe4292d5a,
+	0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a, 0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595,
+	0x417b1dbc, 0xb3109ebf, 0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+	0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f, 0xed03a29b, 0x1f682198,
+	0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927, 0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38,
+	0xdbfc821c, 0x2997011f, 0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+	0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e, 0x4767748a, 0xb50cf789,
+	0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859, 0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46,
+	0x7198540d, 0x83f3d70e, 0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+	0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de, 0xdde0eb2a, 0x2f8b6829,
+	0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c, 0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93,
+	0x082f63b7, 0xfa44e0b4, 0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+	0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b, 0xb4091bff, 0x466298fc,
+	0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c, 0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033,
+	0xa24bb5a6, 0x502036a5, 0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+	0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975, 0x0e330a81, 0xfc588982,
+	0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d, 0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622,
+	0x38cc2a06, 0xcaa7a905, 0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+	0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8, 0xe52cc12c, 0x1747422f,
+	0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff, 0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0,
+	0xd3d3e1ab, 0x21b862a8, 0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+	0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78, 0x7fab5e8c, 0x8dc0dd8f,
+	0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee, 0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1,
+	0x69e9f0d5, 0x9b8273d6, 0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+	0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69, 0xd5cf889d, 0x27a40b9e,
+	0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e, 0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351,
+};
+#endif
+
+uint32_t json_crc32c(uint32_t crc, const void *data, size_t n)
+{
+	const uint8_t *p = data;
+	crc = ~crc;
+#if defined(__SSE4_2__) && defined(__x86_64__)
+	uint64_t c = crc;
+	for (; n >= 8; n -= 8, p += 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		c = _mm_crc32_u64(c, v);
+	}
+	crc = (uint32_t)c;
+	for (; n > 0; --n)
+		crc = _mm_crc32_u8(crc, *p++);
+#else
+	for (; n > 0; --n)
+		crc = g_json_crc32c[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+#endif
+	return ~crc;
+}
+
+/* Reads keep the crc from before each of the last JSON_LOOKAHEAD bytes, so
+ * bytes the reader has fetched but not consumed can be left out. */
+static
+void json__digest_in(json_digest_t *d, const char *p, size_t n)
+{
+	if (n > JSON_LOOKAHEAD) {
+		d->crc = json_crc32c(d->crc, p, n - JSON_LOOKAHEAD);
+		d->pos += n - JSON_LOOKAHEAD;
+		p += n - JSON_LOOKAHEAD;
+		n = JSON_LOOKAHEAD;
+	}
+	for (; n > 0; --n, ++p) {
+		d->hist[d->pos++ % JSON_LOOKAHEAD] = d->crc;
+		d->crc = json_crc32c(d->crc, p, 1);
+	}
+}
+
+static
+int json__digest_fgetc(void *user)
+{
+	json_digest_t *d = user;
+	const int c = d->io.fgetc(d->user);
+	if (c != EOF) {
+		const char ch = (char)c;
+		json__digest_in(d, &ch, 1);
+	}
+	return c;
+}
+
+static
+size_t json__digest_fread(void *ptr, size_t size, size_t nmemb, void *user)
+{
+	json_digest_t *d = user;
+	const size_t r = d->io.fread(ptr, size, nmemb, d->user);
+	json__digest_in(d, ptr, r * size);
+	return r;
+}
+
+static
+size_t json__digest_fwrite(const void *ptr, size_t size, size_t nmemb, void *user)
+{
+	json_digest_t *d = user;
+	const size_t r = d->io.fwrite(ptr, size, nmemb, d->user);
+	d->crc = json_crc32c(d->crc, ptr, r * size);
+	return r;
+}
+
+static
+int json__digest_fputc(int c, void *user)
+{
+	json_digest_t *d = user;
+	const int r = d->io.fputc(c, d->user);
+	if (r != EOF) {
+		const char ch = (char)c;
+		d->crc = json_crc32c(d->crc, &ch, 1);
+	}
+	return r;
+}
+
+static
+long json__digest_ftell(void *user)
+{
+	json_digest_t *d = user;
+	return d->io.ftell(d->user);
+}
+
+static
+int json__digest_finish(void *user)
+{
+	json_digest_t *d = user;
+	return d->io.finish ? d->io.finish(d->user) : 0;
+}
+
+void json_init_digest(json_t *json, json_digest_t *digest, json_io_t io, void *user)
+{
+	/* no view or fseek: every byte has to pass through the crc */
+	const json_io_t wrap = {
+		.fgetc  = json__digest_fgetc,
+		.fread  = json__digest_fread,
+		.fwrite = json__digest_fwrite,
+		.fputc  = json__digest_fputc,
+		.ftell  = io.ftell ? json__digest_ftell : NULL,
+		.finish = json__digest_finish,
+	};
+	digest->io = io;
+	digest->user = user;
+	digest->crc = 0;
+	digest->pos = 0;
+	json_init(json, wrap, digest);
+}
+
+bool json_write_digest(json_t *json, const char *label)
+{
+	const json_digest_t *d = json->user;
+	assert(json->io.fwrite == json__digest_fwrite && "json_t not set up with json_init_digest");
+	char hex[9];
+	snprintf(hex, sizeof(hex), "%08" PRIx32, d->crc);
+	return json_write_str(json, label, hex);
+}
+
+bool json_read_digest(json_t *json, const char *label)
+{
+	const json_digest_t *d = json->user;
+	assert(json->io.fgetc == json__digest_fgetc && "json_t not set up with json_init_digest");
+	/* a peeked label has been consumed along with its separator */
+	const uint32_t crc = json->peeked ? d->peek_crc : json__digest_crc(json);
+	char hex[9];
+	uint32_t val = 0;
+	if (!json_read_str(json, label, hex, sizeof(hex)) || strlen(hex) != 8)
+		return false;
+	for (size_t i = 0; i < 8; ++i) {
+		const int h = json__hex_value((uint8_t)hex[i]);
+		if (h < 0)
+			return false;
+		val = val << 4 | (uint32_t)h;
+	}
+	return val == crc;
+}
+
+/* transcoding */
+
+/* Finds the next '"' or '\\' in string contents. */
+static inline
+const char *json__span_quote(const char *p, const char *end)
+{
+#if defined(__SSE2__)
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i slash = _mm_set1_epi8('\\');
+	while (end - p >= 16) {
+		const __m128i b = _mm_loadu_si128((const __m128i *)p);
+		const int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(b, quote),
+		                                             _mm_cmpeq_epi8(b, slash)));
+		if (m)
+			return p + __builtin_ctz(m);
+		p += 16;
+	}
+#endif
+	while (p < end && *p != '"' && *p != '\\')
+		++p;
+	return p;
+}
+
+typedef struct json__transcoder
+{
+	json_t *dst;
+	bool pretty;
+	bool in_str, esc;
+	bool open;      /* a bracket was just opened; its first member decides the layout */
+	size_t depth;
+	size_t len;     /* output is batched so tokens don't each cost an I/O call */
+	bool wrote;     /* anything reached dst, i.e. the input wasn't empty */
+	char out[4096];
+} json__transcoder_t;
+
+static
+bool json__transcode_flush(json__transcoder_t *t)
+{
+	const size_t len = t->len;
+	t->len = 0;
+	t->wrote = t->wrote || len > 0;
+	return json__fwrite(t->dst, t->out, len) == len;
+}
+
+static
+bool json__transcode_put(json__transcoder_t *t, const char *p, size_t n)
+{
+	if (n > sizeof(t->out) - t->len) {
+		if (!json__transcode_flush(t))
+			return false;
+		if (n > sizeof(t->out)) {
+			t->wrote = true;
+			return json__fwrite(t->dst, p, n) == n;
+		}
+	}
+	memcpy(&t->out[t->len], p, n);
+	t->len += n;
+	return true;
+}
+
+static inline
+bool json__transcode_putc(json__transcoder_t *t, char c)
+{
+	if (t->len == sizeof(t->out) && !json__transcode_flush(t))
+		return false;
+	t->out[t->len++] = c;
+	return true;
+}
+
+static
+bool json__transcode_indent(json__transcoder_t *t)
+{
+	static const char spaces[64] = "                                                                ";
+	size_t n = t->depth * JSON_INDENT_SIZE;
+	if (!json__transcode_putc(t, '\n'))
+		return false;
+	while (n > 0) {
+		const size_t len = json__min(n, sizeof(spaces));
+		if (!json__transcode_put(t, spaces, len))
+			return false;
+		n -= len;
+	}
+	return true;
+}
+
+/* Emits the layout owed before a member once it is known not to be '}' or ']'. */
+static
+bool json__transcode_member(json__transcoder_t *t)
+{
+	if (!t->open)
+		return true;
+	t->open = false;
+	return !t->pretty || json__transcode_indent(t);
+}
+
+static
+bool json__transcode_block(json__transcoder_t *t, const char *p, const char *end)
+{
+	while (p < end) {
+		if (t->esc) {
+			if (!json__transcode_putc(t, *p++))
+				return false;
+			t->esc = false;
+		} else if (t->in_str) {
+			const char *q = json__span_quote(p, end);
+			if (!json__transcode_put(t, p, q - p))
+				return false;
+			if ((p = q) == end)
+				break;
+			/* a backslash keeps the string open & passes the next byte through */
+			t->esc = *p == '\\';
+			t->in_str = *p == '\\';
+			if (!json__transcode_putc(t, *p++))
+				return false;
+		} else {
+			const char c = *p;
+			bool ok = true;
+			switch (c) {
+			case ' ':
+			case '\t':
+			case '\n':
+			case '\r':
+				++p;
+				continue;
+			case '{':
+			case '[':
+				ok = json__transcode_member(t) && json__transcode_putc(t, c);
+				++t->depth;
+				t->open = true;
+				break;
+			case '}':
+			case ']':
+				if (t->depth == 0)
+					return false;
+				--t->depth;
+				ok = (t->open || !t->pretty || json__transcode_indent(t))
+				  && json__transcode_putc(t, c);
+				t->open = false;
+				break;
+			case ',':
+				ok = json__transcode_putc(t, c)
+				  && (!t->pretty || t->depth == 0 || json__transcode_indent(t));
+				break;
+			case ':':
+				ok = t->pretty ? json__transcode_put(t, ": ", 2)
+				               : json__transcode_putc(t, c);
+				break;
+			case '"':
+				ok = json__transcode_member(t) && json__transcode_putc(t, c);
+				t->in_str = true;
+				break;
+			default: {
+				/* numbers & literals are copied through in one piece */
+				const char *q = p + 1;
+				while (   q < end
+				       && ((*q >= '0' && *q <= '9')
+				           || ((*q | 0x20) >= 'a' && (*q | 0x20) <= 'z')
+				           || *q == '.' || *q == '-' || *q == '+'))
+					++q;
+				ok = json__transcode_member(t) && json__transcode_put(t, p, q - p);
+				p = q;
+				if (!ok)
+					return false;
+				continue;
+			}
+			}
+			if (!ok)
+				return false;
+			++p;
+		}
+	}
+	return true;
+}
+
+bool json_transcode(json_t *dst, json_t *src, bool pretty)
+{
+	json__transcoder_t t = { .dst = dst, .pretty = pretty };
+	const char *view;
+	char buf[4096];
+	size_t n;
+
+	if ((view = json__view(src, &n)) != NULL) {
+		if (!json__transcode_block(&t, view, view + n) || !json__view_consume(src, n))
+			return false;
+	} else {
+		while ((n = json__fread(src, buf, sizeof(buf))) > 0)
+			if (!json__transcode_block(&t, buf, buf + n))
+				return false;
+	}
+	/* whitespace only has no value to copy */
+	return json__transcode_flush(&t) && t.wrote && !t.in_str && t.depth == 0;
+}
+
+/* diff & patch */
+
+typedef struct json__path
+{
+	size_t len;
+	char buf[JSON_PATCH_PATH];
+} json__path_t;
+
+/* Appends a JSON pointer segment for a member, escaping '~' & '/'. */
+static
+bool json__path_push_label(json__path_t *path, const char *label, size_t n)
+{
+	if (path->len + 1 >= sizeof(path->buf))
+		return false;
+	path->buf[path->len++] = '/';
+	for (size_t i = 0; i < n; ++i) {
+		const bool esc = label[i] == '~' || label[i] == '/';
+		if (path->len + 1 + esc >= sizeof(path->buf))
+			return false;
+		if (esc) {
+			path->buf[path->len++] = '~';
+			path->buf[path->len++] = label[i] == '~' ? '0' : '1';
+		} else {
+			path->buf[path->len++] = label[i];
+		}
+	}
+	return true;
+}
+
+static
+bool json__path_push_index(json__path_t *path, size_t i)
+{
+	char str[24];
+	const char *p = json__format_u64(str + sizeof(str), i);
+	const size_t n = (size_t)(str + sizeof(str) - p);
+	if (path->len + 1 + n >= sizeof(path->buf))
+		return false;
+	path->buf[path->len++] = '/';
+	memcpy(&path->buf[path->len], p, n);
+	path->len += n;
+	return true;
+}
+
+static
+const char *json__skip_space(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+		++p;
+	return p;
+}
+
+/* Walks the members of an object/array in source text. */
+typedef struct json__members
+{
+	const char *p, *end;
+	bool is_array, first;
+	const char *label, *value; /* label without its quotes; NULL in arrays */
+	size_t label_len, len;
+} json__members_t;
+
+static
+void json__members_begin(json__members_t *m, const char *value, size_t len)
+{
+	m->p = value + 1;
+	m->end = value + len;
+	m->is_array = *value == '[';
+	m->first = true;
+	m->label = NULL;
+	m->label_len = 0;
+}
+
+/* 1 when a member was stepped over, 0 at the closing bracket, -1 on error. */
+static
+int json__members_next(json__members_t *m)
+{
+	const char *p = json__skip_space(m->p, m->end);
+	size_t n;
+
+	if (p == m->end)
+		return -1;
+	if (*p == (m->is_array ? ']' : '}'))
+		return 0;
+	if (!m->first && *p++ != ',')
+		return -1;
+	m->first = false;
+	p = json__skip_space(p, m->end);
+	if (!m->is_array) {
+		if (p == m->end || *p != '"' || (n = json__span_str(p, m->end)) == 0)
+			return -1;
+		m->label = p + 1;
+		m->label_len = n - 2;
+		p = json__skip_space(p + n, m->end);
+		if (p == m->end || *p++ != ':')
+			return -1;
+		p = json__skip_space(p, m->end);
+	}
+	if ((m->len = json__span_value(p, m->end)) == 0)
+		return -1;
+	m->value = p;
+	m->p = p + m->len;
+	return 1;
+}
+
+/* Finds the next value in a viewable source & consumes it. */
+static
+bool json__view_value(json_t *json, const char **value, size_t *len)
+{
+	size_t avail;
+	const char *view = json__view(json, &avail);
+	if (view == NULL)
+		return false;
+	*value = json__skip_space(view, view + avail);
+	*len = json__span_value(*value, view + avail);
+	return *len > 0 && json__view_consume(json, (size_t)(*value - view) + *len);
+}
+
+typedef struct json__diff
+{
+	json_t *patch;
+	json__path_t path;
+} json__diff_t;
+
+/* Writes one patch entry for the current path; a NULL value removes. */
+static
+bool json__diff_emit(json__diff_t *d, const char *value, size_t len)
+{
+	json_obj_t op;
+	json_obj_t *const cur = d->patch->cur;
+	const size_t indent = d->patch->indent;
+	json__transcoder_t t = { .dst = d->patch };
+
+	if (   !json_write_object_begin(d->patch, "", &op)
+	    || !json_write_strn(d->patch, "path", d->path.buf, d->path.len))
+		return json__unwind(d->patch, cur, indent);
+	/* compacted, so the patch reads back whatever layout the source had */
+	if (value && (   !json__write_label(d->patch, "value")
+	              || !json__transcode_block(&t, value, value + len)
+	              || !json__transcode_flush(&t)))
+		return json__unwind(d->patch, cur, indent);
+	return json_write_object_end(d->patch) || json__unwind(d->patch, cur, indent);
+}
+
+static
+bool json__same_labels(const char *a, size_t alen, const char *b, size_t blen)
+{
+	json__members_t ma, mb;
+	int ra;
+
+	json__members_begin(&ma, a, alen);
+	json__members_begin(&mb, b, blen);
+	while ((ra = json__members_next(&ma)) > 0 && json__members_next(&mb) > 0)
+		if (ma.label_len != mb.label_len || memcmp(ma.label, mb.label, ma.label_len) != 0)
+			return false;
+	return ra == 0 && json__members_next(&mb) == 0;
+}
+
+static
+bool json__diff_value(json__diff_t *d, const char *a, size_t alen, const char *b, size_t blen)
+{
+	json__members_t ma, mb;
+	int ra, rb;
+	size_t i = 0;
+
+	if (alen == blen && memcmp(a, b, alen) == 0)
+		return true;
+	if (!(   (*a == '[' && *b == '[')
+	      || (*a == '{' && *b == '{' && json__same_labels(a, alen, b, blen))))
+		return json__diff_emit(d, b, blen);
+
+	json__members_begin(&ma, a, alen);
+	json__members_begin(&mb, b, blen);
+	const size_t len = d->path.len;
+	/* an exhausted side keeps returning 0 at its closing bracket */
+	for (;; ++i, d->path.len = len) {
+		ra = json__members_next(&ma);
+		rb = json__members_next(&mb);
+		if (ra < 0 || rb < 0)
+			return false;
+		if (ra == 0 && rb == 0)
+			return true;
+		if (!(ma.is_array ? json__path_push_index(&d->path, i)
+		                  : json__path_push_label(&d->path, ma.label, ma.label_len)))
+			return false;
+		/* past the end of one of the arrays: removals or appends */
+		if (   (ra > 0 && rb > 0 && !json__diff_value(d, ma.value, ma.len, mb.value, mb.len))
+		    || (ra == 0 && !json__diff_emit(d, mb.value, mb.len))
+		    || (rb == 0 && !json__diff_emit(d, NULL, 0)))
+			return false;
+	}
+}
+
+bool json_diff(json_t *patch, json_t *old_doc, json_t *new_doc)
+{
+	json__diff_t d = { .patch = patch };
+	json_obj_t arr;
+	json_obj_t *const cur = patch->cur;
+	const size_t indent = patch->indent;
+	const char *a, *b;
+	size_t alen, blen;
+
+	return (   json__view_value(old_doc, &a, &alen)
+	        && json__view_value(new_doc, &b, &blen)
+	        && json_write_array_begin(patch, "patch", &arr)
+	        && json__diff_value(&d, a, alen, b, blen)
+	        && json_write_array_end(patch))
+	    || json__unwind(patch, cur, indent);
+}
+
+typedef struct json__patcher
+{
+	json_t *patch;
+	json__transcoder_t out;
+	json__path_t path;
+	/* the next entry, if any */
+	bool has_op;
+	const char *op_path, *op_value; /* op_value is NULL for a removal */
+	size_t op_path_len, op_value_len;
+} json__patcher_t;
+
+static
+bool json__patch_next(json__patcher_t *p)
+{
+	json_obj_t op;
+	json_obj_t *const cur = p->patch->cur;
+	const size_t indent = p->patch->indent;
+	const char *label;
+
+	p->has_op = false;
+	if (json_peek_array_end(p->patch))
+		return true;
+	if (   !json_read_object_begin(p->patch, "", &op)
+	    || !json_read_raw_value_ref(p->patch, "path", &p->op_path, &p->op_path_len)
+	    || p->op_path_len < 2
+	    || *p->op_path != '"')
+		return json__unwind(p->patch, cur, indent);
+	/* compared as written, quotes aside */
+	++p->op_path;
+	p->op_path_len -= 2;
+	p->op_value = NULL;
+	if (   (label = json_peek_label(p->patch)) != NULL
+	    && strcmp(label, "value") == 0
+	    && !json_read_raw_value_ref(p->patch, "value", &p->op_value, &p->op_value_len))
+		return json__unwind(p->patch, cur, indent);
+	if (!json_read_object_end(p->patch))
+		return json__unwind(p->patch, cur, indent);
+	p->has_op = true;
+	return true;
+}
+
+/* Whether the next entry is for the current path (0), somewhere below it
+ * (1: further down, 2: a direct child), or elsewhere (-1). */
+static
+int json__patch_where(const json__patcher_t *p)
+{
+	const size_t n = p->path.len;
+	if (!p->has_op || p->op_path_len < n || memcmp(p->op_path, p->path.buf, n) != 0)
+		return -1;
+	if (p->op_path_len == n)
+		return 0;
+	if (p->op_path[n] != '/')
+		return -1;
+	return memchr(&p->op_path[n + 1], '/', p->op_path_len - n - 1) ? 1 : 2;
+}
+
+static
+bool json__patch_value(json__patcher_t *p, const char *v, size_t vlen)
+{
+	json__members_t m;
+	size_t i = 0;
+	bool first = true;
+	int r;
+
+	switch (json__patch_where(p)) {
+	case 0:
+		return p->op_value
+		    && json__transcode_block(&p->out, p->op_value, p->op_value + p->op_value_len)
+		    && json__patch_next(p);
+	case -1:
+		/* untouched: copied through in one piece */
+		return json__transcode_block(&p->out, v, v + vlen);
+	}
+	if (*v != '{' && *v != '[')
+		return false;
+
+	json__members_begin(&m, v, vlen);
+	if (!json__transcode_block(&p->out, v, v + 1))
+		return false;
+	const size_t len = p->path.len;
+	for (; (r = json__members_next(&m)) > 0; ++i, p->path.len = len) {
+		if (!(m.is_array ? json__path_push_index(&p->path, i)
+		                 : json__path_push_label(&p->path, m.label, m.label_len)))
+			return false;
+		if (json__patch_where(p) == 0 && p->op_value == NULL) {
+			if (!json__patch_next(p))
+				return false;
+			continue;
+		}
+		if (   (!first && !json__transcode_block(&p->out, ",", "," + 1))
+		    || (m.label && (   !json__transcode_block(&p->out, m.label - 1, m.label + m.label_len + 1)
+		                    || !json__transcode_block(&p->out, ":", ":" + 1)))
+		    || !json__patch_value(p, m.value, m.len))
+			return false;
+		first = false;
+	}
+	if (r < 0)
+		return false;
+	/* appended elements */
+	while (m.is_array && json__patch_where(p) == 2) {
+		if (   p->op_value == NULL
+		    || (!first && !json__transcode_block(&p->out, ",", "," + 1))
+		    || !json__transcode_block(&p->out, p->op_value, p->op_value + p->op_value_len)
+		    || !json__patch_next(p))
+			return false;
+		first = false;
+	}
+	return json__patch_where(p) < 0
+	    && json__transcode_block(&p->out, m.is_array ? "]" : "}", m.is_array ? "]" + 1 : "}" + 1);
+}
+
+bool json_patch(json_t *dst, json_t *old_doc, json_t *patch)
+{
+	json__patcher_t p = { .patch = patch, .out = { .dst = dst, .pretty = JSON_PRETTY_PRINT } };
+	json_obj_t arr;
+	json_obj_t *const cur = patch->cur;
+	const size_t indent = patch->indent;
+	const char *v;
+	size_t vlen;
+
+	return (   json__view_value(old_doc, &v, &vlen)
+	        && json_read_array_begin(patch, "patch", &arr)
+	        && json__patch_next(&p)
+	        && json__patch_value(&p, v, vlen)
+	        && !p.has_op
+	        && json_read_array_end(patch)
+	        && json__transcode_flush(&p.out))
+	    || json__unwind(patch, cur, indent);
+}
+
+/* records */
+
+/* The bytes around the values of one record element: segment c ends at
+ * ends[c] & precedes value c, the last one closes the object. */
+typedef struct json__skeleton
+{
+	size_t nseg; /* 0 until one has been laid out or learned */
+	size_t ends[JSON_MEMBERS_MAX + 1];
+	char buf[JSON_SKELETON_MAX];
+} json__skeleton_t;
+
+static
+bool json__skeleton_put(json__skeleton_t *sk, size_t *len, const char *p, size_t n)
+{
+	if (n > sizeof(sk->buf) - *len)
+		return false;
+	memcpy(&sk->buf[*len], p, n);
+	*len += n;
+	return true;
+}
+
+static
+bool json__skeleton_indent(json__skeleton_t *sk, size_t *len, size_t indent)
+{
+#if JSON_PRETTY_PRINT
+	static const char spaces[64] = "                                                                ";
+	size_t n = indent * JSON_INDENT_SIZE;
+	if (!json__skeleton_put(sk, len, "\n", 1))
+		return false;
+	for (; n > sizeof(spaces); n -= sizeof(spaces))
+		if (!json__skeleton_put(sk, len, spaces, sizeof(spaces)))
+			return false;
+	return json__skeleton_put(sk, len, spaces, n);
+#else
+	(void)sk, (void)len, (void)indent;
+	return true;
+#endif
+}
+
+/* Lays out what json__write_label & co. would write around the values of
+ * an element that follows another one at the current indentation. */
+static
+bool json__skeleton_layout(json__skeleton_t *sk, size_t indent, const json_column_t *cols, size_t ncols)
+{
+#if JSON_PRETTY_PRINT
+	static const char colon[] = ": ";
+#else
+	static const char colon[] = ":";
+#endif
+	size_t len = 0;
+
+	sk->nseg = 0;
+	if (   ncols > JSON_MEMBERS_MAX
+	    || !json__skeleton_put(sk, &len, ",", 1)
+	    || !json__skeleton_indent(sk, &len, indent)
+	    || !json__skeleton_put(sk, &len, "{", 1))
+		return false;
+	for (size_t c = 0; c < ncols; ++c) {
+		if (   (c > 0 && !json__skeleton_put(sk, &len, ",", 1))
+		    || !json__skeleton_indent(sk, &len, indent + 1)
+		    || !json__skeleton_put(sk, &len, "\"", 1)
+		    || !json__skeleton_put(sk, &len, cols[c].label, strlen(cols[c].label))
+		    || !json__skeleton_put(sk, &len, "\"", 1)
+		    || !json__skeleton_put(sk, &len, colon, sizeof(colon) - 1))
+			return false;
+		sk->ends[c] = len;
+	}
+	if (   (ncols > 0 && !json__skeleton_indent(sk, &len, indent))
+	    || !json__skeleton_put(sk, &len, "}", 1))
+		return false;
+	sk->ends[ncols] = len;
+	sk->nseg = ncols + 1;
+	return true;
+}
+
+/* Formats one value the way json__write_cell would, without a label. */
+static
+const char *json__format_cell(json_t *json, char str[64], json_column_type_t type, const void *p,
+                              int *len)
+{
+	int64_t i;
+	uint64_t u;
+
+	switch (type) {
+	case JSON_COLUMN_BOOL:
+		*len = *(const bool *)p ? 4 : 5;
+		return *(const bool *)p ? "true" : "false";
+	case JSON_COLUMN_INT8:   i = *(const int8_t *)p;   goto sint;
+	case JSON_COLUMN_INT16:  i = *(const int16_t *)p;  goto sint;
+	case JSON_COLUMN_INT32:  i = *(const int32_t *)p;  goto sint;
+	case JSON_COLUMN_INT64:  i = *(const int64_t *)p;  goto sint;
+	case JSON_COLUMN_UINT8:  u = *(const uint8_t *)p;  goto uint;
+	case JSON_COLUMN_UINT16: u = *(const uint16_t *)p; goto uint;
+	case JSON_COLUMN_UINT32: u = *(const uint32_t *)p; goto uint;
+	case JSON_COLUMN_UINT64: u = *(const uint64_t *)p; goto uint;
+	case JSON_COLUMN_FLOAT:
+		return json__format_real(str, *(const float *)p, true, json->precision, json->precision_n, len);
+	case JSON_COLUMN_DOUBLE:
+		return json__format_real(str, *(const double *)p, false, json->precision, json->precision_n, len);
+	}
+	return NULL;
+
+sint: {
+	char *q = json__format_u64(str + 64, i < 0 ? 0 - (uint64_t)i : (uint64_t)i);
+	if (i < 0)
+		*--q = '-';
+	*len = (int)(str + 64 - q);
+	return q;
+}
+uint: {
+	const char *q = json__format_u64(str + 64, u);
+	*len = (int)(str + 64 - q);
+	return q;
+}
+}
+
+bool json_write_records(json_t *json, const char *label, const void *records, size_t n,
+                        size_t stride, const json_column_t *cols, size_t ncols)
+{
+	json_obj_t arr, obj;
+	json_obj_t *const cur = json->cur;
+	const size_t indent = json->indent;
+	json__skeleton_t sk;
+	json__transcoder_t out = { .dst = json };
+	const char *rec = records;
+	char str[64];
+	int len;
+
+	if (!json_write_array_begin(json, label, &arr))
+		return json__unwind(json, cur, indent);
+	if (n == 0 || !json__skeleton_layout(&sk, json->indent, cols, ncols)) {
+		for (size_t i = 0; i < n; ++i, rec += stride) {
+			if (!json_write_object_begin(json, "", &obj))
+				return json__unwind(json, cur, indent);
+			for (size_t c = 0; c < ncols; ++c)
+				if (!json__write_cell(json, cols[c].label, cols[c].type, rec + cols[c].offset))
+					return json__unwind(json, cur, indent);
+			if (!json_write_object_end(json))
+				return json__unwind(json, cur, indent);
+		}
+		return json_write_array_end(json) || json__unwind(json, cur, indent);
+	}
+
+	for (size_t i = 0; i < n; ++i, rec += stride) {
+		/* the first element has no separator in front */
+		size_t start = i == 0;
+		for (size_t c = 0; c < ncols; ++c) {
+			const char *v = json__format_cell(json, str, cols[c].type, rec + cols[c].offset, &len);
+			if (   len <= 0
+			    || len >= 64
+			    || !json__transcode_put(&out, &sk.buf[start], sk.ends[c] - start)
+			    || !json__transcode_put(&out, v, (size_t)len))
+				return json__unwind(json, cur, indent);
+			start = sk.ends[c];
+			json__count_value(json, cols[c].type == JSON_COLUMN_BOOL ? JSON_TYPE_BOOL : JSON_TYPE_NUMBER);
+		}
+		if (!json__transcode_put(&out, &sk.buf[start], sk.ends[ncols] - start))
+			return json__unwind(json, cur, indent);
+		json__count_value(json, JSON_TYPE_OBJECT);
+	}
+	arr.n = n;
+	return (json__transcode_flush(&out) && json_write_array_end(json))
+	    || json__unwind(json, cur, indent);
+}
+
+#if JSON_PRETTY_PRINT
+#define json__skip_layout(p, end) json__skip_space(p, end)
+#else
+#define json__skip_layout(p, end) (p)
+#endif
+
+/* Length of the JSON number at p, 0 if there isn't a well-formed one. */
+static
+size_t json__span_number(const char *p, const char *end, bool integer)
+{
+	const char *q = p;
+	q += q < end && *q == '-';
+	if (q == end || *q < '0' || *q > '9')
+		return 0;
+	if (*q++ != '0')
+		while (q < end && *q >= '0' && *q <= '9')
+			++q;
+	if (q < end && *q == '.') {
+		if (integer || ++q == end || *q < '0' || *q > '9')
+			return 0;
+		while (q < end && *q >= '0' && *q <= '9')
+			++q;
+	}
+	if (q < end && (*q == 'e' || *q == 'E')) {
+		if (integer)
+			return 0;
+		++q;
+		q += q < end && (*q == '-' || *q == '+');
+		if (q == end || *q < '0' || *q > '9')
+			return 0;
+		while (q < end && *q >= '0' && *q <= '9')
+			++q;
+	}
+	return (size_t)(q - p);
+}
+
+/* Parses one value from memory into a record field; returns its length, or
+ * 0 for anything the ordinary reader should handle (or reject) instead. */
+static
+size_t json__parse_cell(const char *p, const char *end, json_column_type_t type, void *dst)
+{
+	char str[64];
+	uint64_t u;
+	size_t n;
+
+	if (type == JSON_COLUMN_BOOL) {
+		if (end - p >= 4 && memcmp(p, "true", 4) == 0) {
+			*(bool *)dst = true;
+			n = 4;
+		} else if (end - p >= 5 && memcmp(p, "false", 5) == 0) {
+			*(bool *)dst = false;
+			n = 5;
+		} else {
+			return 0;
+		}
+		return n;
+	}
+
+	n = json__span_number(p, end, type != JSON_COLUMN_FLOAT && type != JSON_COLUMN_DOUBLE);
+	if (n == 0 || n >= sizeof(str))
+		return 0;
+	memcpy(str, p, n);
+	str[n] = 0;
+	const bool neg = *p == '-';
+
+	switch (type) {
+	case JSON_COLUMN_FLOAT:
+		*(float *)dst = strtof(str, NULL);
+		return n;
+	case JSON_COLUMN_DOUBLE:
+		if (!json__strtod_fast(str, dst))
+			*(double *)dst = strtod(str, NULL);
+		return n;
+	case JSON_COLUMN_UINT8:
+	case JSON_COLUMN_UINT16:
+	case JSON_COLUMN_UINT32:
+	case JSON_COLUMN_UINT64:
+		if (neg)
+			return 0;
+		break;
+	default:
+		break;
+	}
+
+	const uint64_t max = (uint64_t)INT64_MAX + neg;
+	if (!json__parse_u64(str + neg, type == JSON_COLUMN_UINT64 ? UINT64_MAX : max, &u))
+		return 0;
+	const int64_t i = neg ? (int64_t)(0 - u) : (int64_t)u;
+	switch (type) {
+	case JSON_COLUMN_INT8:   if (i < INT8_MIN  || i > INT8_MAX)  return 0; *(int8_t *)dst  = (int8_t)i;  break;
+	case JSON_COLUMN_INT16:  if (i < INT16_MIN || i > INT16_MAX) return 0; *(int16_t *)dst = (int16_t)i; break;
+	case JSON_COLUMN_INT32:  if (i < INT32_MIN || i > INT32_MAX) return 0; *(int32_t *)dst = (int32_t)i; break;
+	case JSON_COLUMN_INT64:  *(int64_t *)dst = i; break;
+	case JSON_COLUMN_UINT8:  if (u > UINT8_MAX)  return 0; *(uint8_t *)dst  = (uint8_t)u;  break;
+	case JSON_COLUMN_UINT16: if (u > UINT16_MAX) return 0; *(uint16_t *)dst = (uint16_t)u; break;
+	case JSON_COLUMN_UINT32: if (u > UINT32_MAX) return 0; *(uint32_t *)dst = (uint32_t)u; break;
+	case JSON_COLUMN_UINT64: *(uint64_t *)dst = u; break;
+	default: return 0;
+	}
+	return n;
+}
+
+/* Matches one element against the skeleton learned from an earlier one,
+ * or when that fails, against the grammar, learning its layout on the way.
+ * Returns the bytes the element took, 0 if the ordinary reader has to. */
+static
+size_t json__match_record(json__skeleton_t *sk, const char *p, const char *end,
+                          bool comma, char *rec, const json_column_t *cols, size_t ncols)
+{
+	const char *q = p;
+	size_t n, start = 0;
+
+	if (comma && sk->nseg > 0) {
+		for (size_t c = 0; c <= ncols; ++c) {
+			const size_t len = sk->ends[c] - start;
+			if ((size_t)(end - q) < len || memcmp(q, &sk->buf[start], len) != 0)
+				goto learn;
+			q += len;
+			start = sk->ends[c];
+			if (c < ncols) {
+				if ((n = json__parse_cell(q, end, cols[c].type, rec + cols[c].offset)) == 0)
+					return 0;
+				q += n;
+			}
+		}
+		return (size_t)(q - p);
+	}
+
+learn:
+	q = p;
+	start = 0;
+	sk->nseg = 0;
+	for (size_t c = 0; c <= ncols; ++c) {
+		const char *s = q;
+		q = json__skip_layout(q, end);
+		if (c == 0) {
+			if (comma) {
+				if (q == end || *q != ',')
+					return 0;
+				q = json__skip_layout(q + 1, end);
+			}
+			if (q == end || *q != '{')
+				return 0;
+			q = json__skip_layout(q + 1, end);
+		} else if (c < ncols) {
+			if (q == end || *q != ',')
+				return 0;
+			q = json__skip_layout(q + 1, end);
+		}
+		if (c < ncols) {
+			const size_t ll = strlen(cols[c].label);
+			if (   (size_t)(end - q) < ll + 2
+			    || *q != '"'
+			    || memcmp(q + 1, cols[c].label, ll) != 0
+			    || q[ll + 1] != '"')
+				return 0;
+			q = json__skip_layout(q + ll + 2, end);
+			if (q == end || *q != ':')
+				return 0;
+			q = json__skip_layout(q + 1, end);
+		} else {
+			if (q == end || *q != '}')
+				return 0;
+			++q;
+		}
+		/* only an element with a separator in front is worth remembering */
+		if (comma && start != (size_t)-1) {
+			if (ncols <= JSON_MEMBERS_MAX && json__skeleton_put(sk, &start, s, (size_t)(q - s)))
+				sk->ends[c] = start;
+			else
+				start = (size_t)-1;
+		}
+		if (c < ncols) {
+			if ((n = json__parse_cell(q, end, cols[c].type, rec + cols[c].offset)) == 0)
+				return 0;
+			q += n;
+		}
+	}
+	if (comma && start != (size_t)-1)
+		sk->nseg = ncols + 1;
+	return (size_t)(q - p);
+}
+
+bool json_read_records(json_t *json, const char *label, void *records, size_t max, size_t *n,
+                       size_t stride, const json_column_t *cols, size_t ncols)
+{
+	json_obj_t arr, obj;
+	json_obj_t *const cur = json->cur;
+	const size_t indent = json->indent;
+	json__skeleton_t sk;
+	char *rec = records;
+	const char *view;
+	size_t avail, i = 0;
+
+	sk.nseg = 0;
+	*n = 0;
+	if (!json_read_array_begin(json, label, &arr))
+		return json__unwind(json, cur, indent);
+	for (;; ++i, rec += stride) {
+		if ((view = json__view(json, &avail)) != NULL) {
+			const char *end = view + avail;
+			const char *q = json__skip_layout(view, end);
+			if (q < end && *q == ']')
+				break;
+			if (i == max)
+				return json__unwind(json, cur, indent);
+			const size_t len = json__match_record(&sk, view, end, arr.n > 0, rec, cols, ncols);
+			if (len > 0) {
+				for (size_t c = 0; c < ncols; ++c)
+					json__count_value(json, cols[c].type == JSON_COLUMN_BOOL ? JSON_TYPE_BOOL : JSON_TYPE_NUMBER);
+				json__count_value(json, JSON_TYPE_OBJECT);
+				++arr.n;
+				if (!json__view_consume(json, len))
+					return json__unwind(json, cur, indent);
+				continue;
+			}
+		} else if (json_peek_array_end(json)) {
+			break;
+		}
+		if (   i == max
+		    || !json_read_object_begin(json, "", &obj))
+			return json__unwind(json, cur, indent);
+		for (size_t c = 0; c < ncols; ++c)
+			if (!json__read_cell(json, cols[c].label, cols[c].type, rec + cols[c].offset))
+				return json__unwind(json, cur, indent);
+		if (!json_read_object_end(json))
+			return json__unwind(json, cur, indent);
+	}
+	*n = i;
+	return json_read_array_end(json) || json__unwind(json, cur, indent);
+}
+
+/* diagnostics */
+
+#define JSON__ERROR_CONTEXT_BEFORE (JSON_ERROR_CONTEXT / 2)
+
+static
+void json__error_path(const json_t *json, const json_obj_t *obj, char *path, size_t max, size_t *len)
+{
+	const json_obj_t *parent = obj->prev;
+	int n = 0;
+
+	if (parent == NULL)
+		return;
+	json__error_path(json, parent, path, max, len);
+
+	if (parent == &json->root)
+		n = snprintf(&path[*len], max - *len, "%s", obj->label ? obj->label : "");
+	else if (parent->is_array)
+		n = snprintf(&path[*len], max - *len, "[%zu]", parent->n - 1);
+	else
+		n = snprintf(&path[*len], max - *len, ".%s", obj->label ? obj->label : "");
+
+	if (n > 0)
+		*len = json__min(*len + n, max - 1);
+}
+
+static
+void json__error_location(json_t *json, json_error_t *err)
+{
+	char buf[4096];
+	size_t pos = 0;
+
+	/* Everything here is recomputed from the source on demand so that the
+	 * success path never has to count lines. */
+	const long saved = json->io.ftell(json->user);
+	if (saved < 0 || json->io.fseek(0, SEEK_SET, json->user) != 0)
+		return;
+	err->offset = (size_t)saved;
+
+	err->line = 1;
+	err->column = 1;
+	while (pos < err->offset) {
+		const size_t want = json__min(sizeof(buf), err->offset - pos);
+		const size_t got = json->io.fread(buf, 1, want, json->user);
+		for (size_t i = 0; i < got; ++i) {
+			if (buf[i] == '\n') {
+				++err->line;
+				err->column = 1;
+			} else {
+				++err->column;
+			}
+		}
+		pos += got;
+		if (got < want)
+			break;
+	}
+
+	const size_t start = err->offset - json__min(err->offset, JSON__ERROR_CONTEXT_BEFORE);
+	if (json->io.fseek((long)start, SEEK_SET, json->user) == 0) {
+		const size_t got = json->io.fread(err->context, 1, JSON_ERROR_CONTEXT, json->user);
+		for (size_t i = 0; i < got; ++i)
+			if ((unsigned char)err->context[i] < ' ')
+				err->context[i] = ' ';
+		err->context[got] = 0;
+		err->context_pos = err->offset - start;
+	}
+
+	json->io.fseek(saved, SEEK_SET, json->user);
+}
+
+void json_get_error(json_t *json, json_error_t *err)
+{
+	size_t len = 0;
+
+	memset(err, 0, sizeof(*err));
+
+	json__error_path(json, json->cur, err->path, sizeof(err->path), &len);
+	if (json->cur != &json->root && json->cur->n > 0) {
+		if (json->cur->is_array)
+			snprintf(&err->path[len], sizeof(err->path) - len, "[%zu]", json->cur->n - 1);
+		else
+			snprintf(&err->path[len], sizeof(err->path) - len, ".%s", json->label ? json->label : "");
+	}
+
+	if (json->io.ftell && json->io.fseek && json->io.fread && json__sync(json))
+		json__error_location(json, err);
+}
+
+/* validation */
+
+enum
+{
+	JSON__V_VALUE,       /* a value is required */
+	JSON__V_FIRST_ELEM,  /* after '[': a value or ']' */
+	JSON__V_FIRST_KEY,   /* after '{': a key or '}' */
+	JSON__V_KEY,         /* after ',' in an object */
+	JSON__V_COLON,
+	JSON__V_NEXT,        /* after a nested value: ',' or the closing bracket */
+	JSON__V_END,         /* after the root value: only whitespace */
+	JSON__V_STR,
+	JSON__V_ESC,
+	JSON__V_HEX,
+	JSON__V_LOW_ESC,     /* a high surrogate needs "\u" + low surrogate next */
+	JSON__V_LOW_U,
+	JSON__V_UTF8,
+	JSON__V_N,           /* 'n' of null, or of nan when allowed */
+	JSON__V_LIT,
+	JSON__V_MINUS,
+	JSON__V_ZERO,
+	JSON__V_INT,
+	JSON__V_DOT,
+	JSON__V_FRAC,
+	JSON__V_E,
+	JSON__V_ESIGN,
+	JSON__V_EXP,
+	JSON__V_ERROR,
+};
+
+static inline
+bool json__is_space(uint8_t c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline
+bool json__validator_in_array(const json_validator_t *v)
+{
+	const size_t i = v->depth - 1;
+	return v->stack[i >> 3] & (1u << (i & 7));
+}
+
+/* State after the first character of a value. */
+static
+int json__validator_value(json_validator_t *v, uint8_t c)
+{
+	v->key = false;
+	switch (c) {
+	case '{':
+	case '[':
+		if (v->depth == JSON_VALIDATE_DEPTH)
+			return JSON__V_ERROR;
+		if (c == '[')
+			v->stack[v->depth >> 3] |= (uint8_t)(1u << (v->depth & 7));
+		else
+			v->stack[v->depth >> 3] &= (uint8_t)~(1u << (v->depth & 7));
+		++v->depth;
+		return c == '[' ? JSON__V_FIRST_ELEM : JSON__V_FIRST_KEY;
+	case '"':
+		return JSON__V_STR;
+	case '-':
+		return JSON__V_MINUS;
+	case '0':
+		return JSON__V_ZERO;
+	case 't':
+		v->lit = "rue";
+		return JSON__V_LIT;
+	case 'f':
+		v->lit = "alse";
+		return JSON__V_LIT;
+	case 'n':
+		return JSON__V_N;
+	case 'i':
+		v->lit = "nf";
+		return v->allow_nonfinite ? JSON__V_LIT : JSON__V_ERROR;
+	default:
+		return c >= '1' && c <= '9' ? JSON__V_INT : JSON__V_ERROR;
+	}
+}
+
+void json_validator_init(json_validator_t *v)
+{
+	memset(v, 0, sizeof(*v));
+	v->state = JSON__V_VALUE;
+}
+
+bool json_validator_feed(json_validator_t *v, const char *buf, size_t len)
+{
+	const uint8_t *const begin = (const uint8_t *)buf;
+	const uint8_t *p = begin;
+	const uint8_t *const end = begin + len;
+	int s = v->state;
+	int h;
+
+	if (s == JSON__V_ERROR)
+		return false;
+
+#define JSON__V_DONE() (s = v->depth ? JSON__V_NEXT : JSON__V_END)
+
+	while (p < end) {
+		uint8_t c = *p;
+		switch (s) {
+		case JSON__V_STR:
+			p = json__span_plain(p, end);
+			if (p == end)
+				continue;
+			c = *p;
+			if (c == '"') {
+				if (v->key)
+					s = JSON__V_COLON;
+				else
+					JSON__V_DONE();
+			} else if (c == '\\') {
+				s = JSON__V_ESC;
+			} else if (c < ' ' || !json__utf8_lead(c, &v->need, &v->lo, &v->hi)) {
+				goto fail;
+			} else {
+				s = JSON__V_UTF8;
+			}
+			break;
+
+		case JSON__V_UTF8:
+			if (c < v->lo || c > v->hi)
+				goto fail;
+			v->lo = 0x80;
+			v->hi = 0xbf;
+			if (--v->need == 0)
+				s = JSON__V_STR;
+			break;
+
+		case JSON__V_ESC:
+			if (c == 'u') {
+				v->hex = 0;
+				v->nhex = 0;
+				s = JSON__V_HEX;
+			} else if (c && strchr("\"\\/bfnrt", c)) {
+				s = JSON__V_STR;
+			} else {
+				goto fail;
+			}
+			break;
+
+		case JSON__V_HEX:
+			if ((h = json__hex_value(c)) < 0)
+				goto fail;
+			v->hex = v->hex << 4 | (uint32_t)h;
+			if (++v->nhex < 4)
+				break;
+			if (v->high) {
+				if (v->hex < 0xdc00 || v->hex > 0xdfff)
+					goto fail;
+				v->high = false;
+				s = JSON__V_STR;
+			} else if (v->hex >= 0xd800 && v->hex <= 0xdbff) {
+				v->high = true;
+				s = JSON__V_LOW_ESC;
+			} else if (v->hex >= 0xdc00 && v->hex <= 0xdfff) {
+				goto fail;
+			} else {
+				s = JSON__V_STR;
+			}
+			break;
+
+		case JSON__V_LOW_ESC:
+			if (c != '\\')
+				goto fail;
+			s = JSON__V_LOW_U;
+			break;
+
+		case JSON__V_LOW_U:
+			if (c != 'u')
+				goto fail;
+			v->hex = 0;
+			v->nhex = 0;
+			s = JSON__V_HEX;
+			break;
+
+		case JSON__V_N:
+			if (c == 'u')
+				v->lit = "ll";
+			else if (c == 'a' && v->allow_nonfinite)
+				v->lit = "n";
+			else
+				goto fail;
+			s = JSON__V_LIT;
+			break;
+
+		case JSON__V_LIT:
+			if (c != (uint8_t)*v->lit++)
+				goto fail;
+			if (*v->lit == 0)
+				JSON__V_DONE();
+			break;
+
+		case JSON__V_MINUS:
+			if (c == '0') {
+				s = JSON__V_ZERO;
+			} else if (c >= '1' && c <= '9') {
+				s = JSON__V_INT;
+			} else if (v->allow_nonfinite && (c == 'i' || c == 'n')) {
+				v->lit = c == 'i' ? "nf" : "an";
+				s = JSON__V_LIT;
+			} else {
+				goto fail;
+			}
+			break;
+
+		case JSON__V_INT:
+		case JSON__V_FRAC:
+		case JSON__V_EXP:
+			while (p < end && *p >= '0' && *p <= '9')
+				++p;
+			if (p == end)
+				continue;
+			c = *p;
+			/* fall through */
+		case JSON__V_ZERO:
+			if (c == '.' && (s == JSON__V_ZERO || s == JSON__V_INT)) {
+				s = JSON__V_DOT;
+			} else if ((c == 'e' || c == 'E') && s != JSON__V_EXP) {
+				s = JSON__V_E;
+			} else {
+				/* the number ended; look at c again as what follows it */
+				JSON__V_DONE();
+				continue;
+			}
+			break;
+
+		case JSON__V_DOT:
+		case JSON__V_ESIGN:
+			if (c < '0' || c > '9')
+				goto fail;
+			s = s == JSON__V_DOT ? JSON__V_FRAC : JSON__V_EXP;
+			break;
+
+		case JSON__V_E:
+			if (c == '+' || c == '-')
+				s = JSON__V_ESIGN;
+			else if (c >= '0' && c <= '9')
+				s = JSON__V_EXP;
+			else
+				goto fail;
+			break;
+
+		default:
+			/* structural states: skip whitespace, then one token */
+			if (json__is_space(c))
+				break;
+			if (s == JSON__V_END) {
+				goto fail;
+			} else if (s == JSON__V_COLON) {
+				if (c != ':')
+					goto fail;
+				s = JSON__V_VALUE;
+			} else if (s == JSON__V_KEY || (s == JSON__V_FIRST_KEY && c != '}')) {
+				if (c != '"')
+					goto fail;
+				v->key = true;
+				s = JSON__V_STR;
+			} else if (s == JSON__V_VALUE || (s == JSON__V_FIRST_ELEM && c != ']')) {
+				if ((s = json__validator_value(v, c)) == JSON__V_ERROR)
+					goto fail;
+			} else if (s == JSON__V_NEXT && c == ',') {
+				s = json__validator_in_array(v) ? JSON__V_VALUE : JSON__V_KEY;
+			} else if (c == (json__validator_in_array(v) ? ']' : '}')) {
+				--v->depth;
+				JSON__V_DONE();
+			} else {
+				goto fail;
+			}
+			break;
+		}
+		++p;
+	}
+
+#undef JSON__V_DONE
+
+	v->state = s;
+	v->offset += len;
+	return true;
+
+fail:
+	v->state = JSON__V_ERROR;
+	v->offset += (size_t)(p - begin);
+	return false;
+}
+
+bool json_validator_finish(json_validator_t *v)
+{
+	switch (v->state) {
+	case JSON__V_ZERO:
+	case JSON__V_INT:
+	case JSON__V_FRAC:
+	case JSON__V_EXP:
+		/* a root number is only terminated by the end of input */
+		if (v->depth == 0) {
+			v->state = JSON__V_END;
+			return true;
+		}
+		return false;
+	case JSON__V_END:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool json_validate(const char *buf, size_t len)
+{
+	json_validator_t v;
+	json_validator_init(&v);
+	return json_validator_feed(&v, buf, len)
+	    && json_validator_finish(&v);
+}
+
+bool json_validate_io(json_io_t io, void *user)
+{
+	json_validator_t v;
+	char buf[4096];
+	size_t n;
+	json_validator_init(&v);
+	while ((n = io.fread(buf, 1, sizeof(buf), user)) > 0)
+		if (!json_validator_feed(&v, buf, n))
+			return false;
+	return json_validator_finish(&v);
+}
@@ -6,6 +6,10 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #ifndef JSON_PRETTY_PRINT
 #define JSON_PRETTY_PRINT 1
 #endif
@@ -14,6 +18,69 @@
 #define JSON_INDENT_SIZE 1
 #endif
 
+/* Single translation unit build: define JSON_IMPLEMENTATION in exactly one
+ * file before including json.h and json.c is compiled into that file.
+ * JSON_IO_STATIC may additionally name the only backend that file's json_t
+ * objects will use (JSON_IO_MEM, JSON_IO_FILE, or the prefix of a custom set
+ * of <prefix>fgetc/ungetc/fread/fwrite/fputc functions declared beforehand).
+ * I/O calls then bypass json_io_t and can be inlined. */
+#define JSON_IO_MEM  json__mem_
+#define JSON_IO_FILE json__file_
+
+/* Bytes of source text captured around an error by json_get_error. */
+#ifndef JSON_ERROR_CONTEXT
+#define JSON_ERROR_CONTEXT 64
+#endif
+
+/* Bytes the reader can look ahead by (json_peek_type needs 2,
+ * json_read_blob_part 5). */
+#ifndef JSON_LOOKAHEAD
+#define JSON_LOOKAHEAD 8
+#endif
+#if JSON_LOOKAHEAD < 5
+#error "JSON_LOOKAHEAD must be at least 5"
+#endif
+
+/* Longest member label json_peek_label can hold, including the terminator. */
+#ifndef JSON_LABEL_MAX
+#define JSON_LABEL_MAX 64
+#endif
+
+/* Longest JSON pointer json_diff & json_patch track, including the terminator. */
+#ifndef JSON_PATCH_PATH
+#define JSON_PATCH_PATH 1024
+#endif
+
+/* Most members a json_labels_t can dispatch. */
+#ifndef JSON_MEMBERS_MAX
+#define JSON_MEMBERS_MAX 64
+#endif
+/* json_read_members reports them in 64 bits, the slots by 8-bit index */
+#if JSON_MEMBERS_MAX > 64
+#error "JSON_MEMBERS_MAX can't exceed 64"
+#endif
+
+/* Room for the layout between the values of one json_*_records element. */
+#ifndef JSON_SKELETON_MAX
+#define JSON_SKELETON_MAX 1024
+#endif
+
+/* Deepest object/array nesting the validator accepts. */
+#ifndef JSON_VALIDATE_DEPTH
+#define JSON_VALIDATE_DEPTH 1024
+#endif
+
+/* Per-json_t counters and tracing hooks.  Compiled out entirely by default. */
+#ifndef JSON_STATS
+#define JSON_STATS 0
+#endif
+
+/* Cycle timing per phase (requires JSON_STATS).  JSON_STATS_CLOCK may be
+ * defined to any function-like macro returning a monotonic uint64_t. */
+#ifndef JSON_STATS_TIMING
+#define JSON_STATS_TIMING 0
+#endif
+
 typedef struct json_mem
 {
 	char *buf; /* effectively const for read calls */
@@ -23,40 +90,221 @@ typedef struct json_mem
 typedef struct json_io
 {
 	int(*fgetc)(void *user);
-	int(*ungetc)(int c, void *user);
+	int(*ungetc)(int c, void *user); /* unused: json_t keeps its own lookahead */
 	size_t(*fread)(void *ptr, size_t size, size_t nmemb, void *user);
 	size_t(*fwrite)(const void *ptr, size_t size, size_t nmemb, void *user);
 	int(*fputc)(int c, void *user);
+	/* Optional.  Used to locate errors after the fact & to skip input. */
+	long(*ftell)(void *user);
+	int(*fseek)(long offset, int whence, void *user);
+	/* Optional.  Returns the unread input as one contiguous block, which
+	 * enables zero-copy reads.  Requires fseek. */
+	const char *(*view)(size_t *len, void *user);
+	/* Optional.  Completes buffered output; returns 0 or EOF on error. */
+	int(*finish)(void *user);
 } json_io_t;
 
+/* Caller-owned bump allocator for the *_alloc reads.  Everything allocated
+ * from it is released at once with json_arena_reset. */
+typedef struct json_arena
+{
+	char *buf;
+	size_t pos, len;
+} json_arena_t;
+
+/* How json_write_float & json_write_double format values.  Both fixed modes
+ * trim trailing zeros, so 1.5 at 3 decimals is written as 1.5. */
+typedef enum json_precision
+{
+	JSON_PRECISION_EXACT,    /* enough digits to round-trip (the default) */
+	JSON_PRECISION_DECIMALS, /* rounded to n places after the point, n <= 19 */
+	JSON_PRECISION_DIGITS,   /* rounded to n significant digits, 1 <= n <= 17 */
+} json_precision_t;
+
+/* Pass-through backend keeping a CRC32C of every byte that goes through it
+ * (SSE4.2 when available).  Set up with json_init_digest, which hides the
+ * wrapped backend's view & fseek so that no byte bypasses the checksum. */
+typedef struct json_digest
+{
+	json_io_t io; /* the wrapped backend */
+	void *user;
+	uint32_t crc; /* of everything written or read so far */
+	/* internal */
+	uint64_t pos;
+	uint32_t hist[JSON_LOOKAHEAD];
+	uint32_t peek_crc; /* before the separator of a peeked member */
+} json_digest_t;
+
 typedef struct json_obj
 {
 	size_t n;
 	bool is_array;
+	const char *label;
 	struct json_obj *prev;
 } json_obj_t;
 
+typedef enum json_type
+{
+	JSON_TYPE_NULL,
+	JSON_TYPE_BOOL,
+	JSON_TYPE_NUMBER,
+	JSON_TYPE_STRING,
+	JSON_TYPE_OBJECT,
+	JSON_TYPE_ARRAY,
+	JSON_TYPE_COUNT,
+} json_type_t;
+
+#if JSON_STATS
+typedef enum json_phase
+{
+	JSON_PHASE_IO,     /* inside json_io_t callbacks */
+	JSON_PHASE_NUMBER, /* number formatting & parsing (snprintf/strtod) */
+	JSON_PHASE_STRING, /* string escaping & unescaping, including its I/O */
+	JSON_PHASE_COUNT,
+} json_phase_t;
+
+typedef struct json_stats
+{
+	uint64_t bytes_in, bytes_out;
+	uint64_t io_calls;
+	uint64_t values[JSON_TYPE_COUNT];
+	size_t max_depth;
+	uint64_t cycles[JSON_PHASE_COUNT]; /* only filled with JSON_STATS_TIMING */
+} json_stats_t;
+
+struct json;
+
+/* Called after an object/array is opened (begin = true) and after it is closed.
+ * `label` is the label the object was opened with. */
+typedef void(*json_trace_fn)(struct json *json, const char *label, bool is_array, bool begin, void *user);
+#endif
+
 typedef struct json
 {
 	void *user;
 	json_io_t io;
 	size_t indent;
-	size_t line;
+	const char *label; /* most recent member label */
+	json_arena_t *arena;
+	json_precision_t precision;
+	int precision_n;
+	/* lookahead: bytes put back by the reader & a peeked member label */
+	char ahead[JSON_LOOKAHEAD];
+	size_t nahead;
+	bool peeked;
+	bool peek_long; /* the peeked label didn't fit & was cut short */
+	char peek[JSON_LABEL_MAX];
 	json_obj_t root;
 	json_obj_t *cur;
+#if JSON_STATS
+	json_stats_t stats;
+	json_trace_fn trace;
+	void *trace_user;
+#endif
 } json_t;
 
+typedef struct json_error
+{
+	size_t offset;       /* stream position when the error was reported */
+	size_t line, column; /* 1-based, 0 if the source can't be re-read */
+	char context[JSON_ERROR_CONTEXT + 1]; /* source text around `offset` */
+	size_t context_pos;  /* index of `offset` within `context` */
+	char path[256];      /* e.g. root.points[3].x */
+} json_error_t;
+
+typedef struct json_defer
+{
+	long offset;       /* position of the value's opening bracket */
+	size_t depth;      /* nesting depth of the value */
+	const char *label;
+	bool is_array;
+} json_defer_t;
+
+typedef enum json_column_type
+{
+	JSON_COLUMN_BOOL,
+	JSON_COLUMN_INT8,
+	JSON_COLUMN_UINT8,
+	JSON_COLUMN_INT16,
+	JSON_COLUMN_UINT16,
+	JSON_COLUMN_INT32,
+	JSON_COLUMN_UINT32,
+	JSON_COLUMN_INT64,
+	JSON_COLUMN_UINT64,
+	JSON_COLUMN_FLOAT,
+	JSON_COLUMN_DOUBLE,
+} json_column_type_t;
+
+/* One scalar member of a record, for the columnar & record functions. */
+typedef struct json_column
+{
+	const char *label;
+	size_t offset;
+	json_column_type_t type;
+} json_column_t;
+
+#define JSON_COLUMN(record, member, type) { #member, offsetof(record, member), JSON_COLUMN_##type }
+
+/* An expected member of an object read in any order.  `read` reads its value,
+ * e.g. with json_read_int32(json, label, ...); json_read_member_index leaves
+ * it unused. */
+typedef struct json_member
+{
+	const char *label;
+	bool(*read)(json_t *json, const char *label, void *user);
+} json_member_t;
+
+/* Perfect hash over a set of labels, built once by json_labels_init. */
+typedef struct json_labels
+{
+	const json_member_t *members;
+	size_t n;
+	uint32_t seed, mask;
+	uint8_t slots[JSON_MEMBERS_MAX * 8]; /* member index, 0xff if empty */
+} json_labels_t;
+
+/* Push-style validator state.  Input may be fed in pieces of any size. */
+typedef struct json_validator
+{
+	size_t offset;        /* bytes accepted, or the offending byte on failure */
+	size_t depth;
+	bool allow_nonfinite; /* accept the nan/inf json_write_double can emit */
+	/* internal */
+	int state;
+	const char *lit;      /* rest of the literal being matched */
+	uint32_t hex;         /* \u escape being accumulated */
+	uint8_t nhex, need, lo, hi;
+	bool key, high;
+	uint8_t stack[(JSON_VALIDATE_DEPTH + 7) / 8]; /* bit set per open array */
+} json_validator_t;
+
 extern const json_io_t g_json_io_mem;
 extern const json_io_t g_json_io_file;
 
 void json_init(json_t *json, json_io_t io, void *user);
 void json_init_file(json_t *json, FILE *fp);
 void json_init_mem(json_t *json, json_mem_t *mem);
+void json_set_arena(json_t *json, json_arena_t *arena);
+/* Applies to every later json_write_float/double on `json`. */
+void json_set_precision(json_t *json, json_precision_t precision, int n);
+void json_init_digest(json_t *json, json_digest_t *digest, json_io_t io, void *user);
+/* Flushes the backend once writing is done.  Returns false if any output
+ * failed to reach its destination. */
+bool json_finish(json_t *json);
+
+void *json_arena_alloc(json_arena_t *arena, size_t size, size_t align);
+void json_arena_reset(json_arena_t *arena);
+
+#if JSON_STATS
+void json_set_trace(json_t *json, json_trace_fn trace, void *user);
+void json_reset_stats(json_t *json);
+#endif
 
 bool json_write_object_begin(json_t *json, const char *label, json_obj_t *obj);
 bool json_write_object_end(json_t *json);
 /* Writes an arbitrary (unvalidated) JSON blob inside the current stream. */
 bool json_write_raw_value(json_t *json, const char *label, const char *value);
+bool json_write_raw_valuen(json_t *json, const char *label, const char *value, size_t n);
 bool json_write_array_begin(json_t *json, const char *label, json_obj_t *obj);
 bool json_write_array_end(json_t *json);
 bool json_write_null(json_t *json, const char *label);
@@ -69,10 +317,17 @@ bool json_write_float(json_t *json, const char *label, float val);
 bool json_write_int64(json_t *json, const char *label, int64_t val);
 bool json_write_uint64(json_t *json, const char *label, uint64_t val);
 bool json_write_double(json_t *json, const char *label, double val);
+/* json_write_double with a precision for this value only. */
+bool json_write_double_prec(json_t *json, const char *label, double val,
+                            json_precision_t precision, int n);
 bool json_write_char(json_t *json, const char *label, char val);
 bool json_write_str(json_t *json, const char *label, const char *val);
 bool json_write_strn(json_t *json, const char *label, const char *val, size_t n);
+/* Like json_write_str, for strings that are not NULL-terminated. */
+bool json_write_strn_escaped(json_t *json, const char *label, const char *val, size_t n);
 bool json_write_str_unescaped(json_t *json, const char *label, const char *val);
+/* Writes binary data as a base64 string. */
+bool json_write_blob(json_t *json, const char *label, const void *data, size_t n);
 
 bool json_read_member_label(json_t *json, const char *label);
 bool json_read_object_begin(json_t *json, const char *label, json_obj_t *obj);
@@ -95,8 +350,151 @@ bool json_read_char(json_t *json, const char *label, char *val);
 bool json_read_str(json_t *json, const char *label, char *val, size_t max);
 bool json_read_strn(json_t *json, const char *label, char *val, size_t n);
 bool json_read_str_part(json_t *json, const char *label, char *val, size_t max, size_t *len, bool *more);
+/* Reads a string into exactly-sized storage from the json_t's arena. */
+bool json_read_str_alloc(json_t *json, const char *label, char **val, size_t *len);
+/* Begins an array of `n` elements (typically read from a preceding size
+ * member) and allocates storage for them from the json_t's arena. */
+bool json_read_array_alloc(json_t *json, const char *label, json_obj_t *obj,
+                           size_t n, size_t size, size_t align, void **items);
+/* Reads a base64 string written by json_write_blob.  json_read_blob fails if
+ * the data does not fit in `max`.  The _part variant follows the
+ * json_read_str_part protocol: when `data` fills up, `more` is set and the
+ * call can be repeated with a larger buffer. */
+bool json_read_blob(json_t *json, const char *label, void *data, size_t max, size_t *len);
+bool json_read_blob_part(json_t *json, const char *label, void *data, size_t max, size_t *len, bool *more);
+
+/* Captures the exact bytes of the next value (object, array, string or scalar)
+ * so it can be forwarded with json_write_raw_valuen.  json_read_raw_value
+ * copies into `buf` & NULL-terminates it.  json_read_raw_value_ref returns a
+ * pointer into the source instead; it needs a backend with a `view` callback,
+ * such as memory, and fails without consuming anything otherwise.
+ * json_skip_value discards the next value. */
+bool json_read_raw_value(json_t *json, const char *label, char *buf, size_t max, size_t *len);
+bool json_read_raw_value_ref(json_t *json, const char *label, const char **value, size_t *len);
+bool json_skip_value(json_t *json, const char *label);
+
+/* Records where the next object/array starts and skips past it.  Later,
+ * json_read_resume initializes a new json_t positioned at that value, ready
+ * for json_read_object_begin/json_read_array_begin.  `io`/`user` must be a
+ * separate seekable handle on the same source (e.g. a second json_mem_t over
+ * the same buffer, or another FILE), and the backend needs ftell & fseek. */
+bool json_read_defer(json_t *json, const char *label, json_defer_t *defer);
+bool json_read_resume(json_t *json, json_io_t io, void *user, const json_defer_t *defer);
+
+/* Size helpers for blobs.  The decoded size is exact for a complete encoded
+ * string; prefer writing the size as a preceding member when streaming. */
+size_t json_blob_encoded_size(size_t n);
+size_t json_blob_decoded_size(const char *str, size_t n);
+
+/* Struct-of-arrays form for arrays of records: one array per column,
+ * {"x": [...], "y": [...]}, gathered from / scattered to `records` laid out
+ * `stride` bytes apart.  Reading stores up to `max` records & sets *n; every
+ * column must hold the same number of values. */
+bool json_write_columns(json_t *json, const char *label, const void *records, size_t n,
+                        size_t stride, const json_column_t *cols, size_t ncols);
+bool json_read_columns(json_t *json, const char *label, void *records, size_t max, size_t *n,
+                       size_t stride, const json_column_t *cols, size_t ncols);
+
+/* Array-of-objects form, [{"x": 0, "y": 0}, ...], as the member-by-member
+ * calls would write it, for arrays of flat records.  Everything between the
+ * values (brackets, labels, separators, indentation) is the same in every
+ * element, so it is laid out once & then copied or, when reading a viewable
+ * source, checked with memcmp, leaving only the values to format & parse.
+ * Elements that don't match fall back to the ordinary reader. */
+bool json_write_records(json_t *json, const char *label, const void *records, size_t n,
+                        size_t stride, const json_column_t *cols, size_t ncols);
+bool json_read_records(json_t *json, const char *label, void *records, size_t max, size_t *n,
+                       size_t stride, const json_column_t *cols, size_t ncols);
+
+/* Quantized delta form for runs of nearby values (polylines, point clouds):
+ * {"origin": o, "scale": s, "n": n, "deltas": [...]} with value i rounded to
+ * o + s * (deltas[0] + ... + deltas[i]).  Valid JSON of small integers, which
+ * format & parse far faster than doubles.  `stride` as for the columns.
+ * The header ignores json_set_precision; either side fails unless origin is
+ * finite & scale positive & finite. */
+bool json_write_delta_array(json_t *json, const char *label, const double *vals, size_t n,
+                            size_t stride, double origin, double scale);
+bool json_read_delta_array(json_t *json, const char *label, double *vals, size_t max, size_t *n,
+                           size_t stride);
+
+/* CRC32C as an 8 digit hex string member, over everything the json_t set up
+ * with json_init_digest has written before it / consumed before it.  Write it
+ * as the last member of the root object; reading fails on a mismatch.  It
+ * may have been peeked, e.g. to be read by a json_read_members handler.  One
+ * pass, so a load no longer needs a separate hashing read. */
+bool json_write_digest(json_t *json, const char *label);
+bool json_read_digest(json_t *json, const char *label);
+/* Continues `crc` (0 to start) over n more bytes. */
+uint32_t json_crc32c(uint32_t crc, const void *data, size_t n);
 
 bool json_peek_array_end(json_t *json);
 bool json_peek_data_end(json_t *json);
+/* The label of the next member ("" in an array), or NULL at the end of the
+ * object/array.  Reading the member afterwards doesn't re-read the label; a
+ * json_read_* call with a different label fails without consuming anything,
+ * so optional & versioned members can be probed in a single pass.  A label
+ * of JSON_LABEL_MAX bytes or more comes back cut short & only matches the
+ * returned pointer itself, e.g. to json_skip_value it. */
+const char *json_peek_label(json_t *json);
+/* Type of the next value, or JSON_TYPE_COUNT at the end of the object/array.
+ * Use it to pick json_read_null vs. the typed read for nullable members. */
+json_type_t json_peek_type(json_t *json);
+
+/* Out-of-order reading for hand-edited or foreign files.  The next member's
+ * label is peeked & looked up in O(1), without strcmp chains.
+ * json_read_member_index gives the member's index (labels->n if unknown:
+ * skip it with json_skip_value(json, json_peek_label(json))) so a switch can
+ * read it with its own label; false at the end of the object.
+ * json_read_members reads a whole object that way, calling each member's
+ * handler & skipping unknown ones; `seen` (may be NULL) gets a bit per member
+ * read, to check for required ones.  Ordered reads stay the default & pay
+ * nothing for this.  Labels too long to peek are always unknown, so
+ * json_labels_init fails on those, on duplicates & on over
+ * JSON_MEMBERS_MAX labels. */
+bool json_labels_init(json_labels_t *labels, const json_member_t *members, size_t n);
+bool json_read_member_index(json_t *json, const json_labels_t *labels, size_t *index);
+bool json_read_members(json_t *json, const char *label, const json_labels_t *labels, void *user,
+                       uint64_t *seen);
+
+/* Copies the JSON text read from src to dst with its whitespace removed, or
+ * re-laid out the way the writer does with JSON_PRETTY_PRINT.  Schema-less;
+ * the input is assumed to be well-formed (see json_validate), but has to
+ * hold a value: empty or whitespace-only input fails. */
+bool json_transcode(json_t *dst, json_t *src, bool pretty);
+
+/* Writes the changes from old_doc to new_doc as an array of
+ * {"path": "/points/3/x", "value": ...} in document order, where a path with
+ * no value removes that array element & one past the end of an array appends.
+ * Members are matched by position, as everything in JSOON is, & identical
+ * ranges are skipped with memcmp, so no tree is built; the sources have to be
+ * viewable (memory).  An object whose labels changed is replaced whole. */
+bool json_diff(json_t *patch, json_t *old_doc, json_t *new_doc);
+/* Streams old_doc to dst with a json_diff patch applied.  old_doc & patch have
+ * to be viewable; the output is laid out like the writer's own. */
+bool json_patch(json_t *dst, json_t *old_doc, json_t *patch);
+
+/* Describes where the last failed call left the stream.  The line, column &
+ * context are recomputed by re-reading the source through the ftell/fseek/fread
+ * callbacks, and the path comes from the open json_obj_t chain. */
+void json_get_error(json_t *json, json_error_t *err);
+
+/* Checks that the input is exactly one well-formed JSON value: strict number
+ * grammar, valid UTF-8 & escapes, nesting within JSON_VALIDATE_DEPTH.  Nothing
+ * is converted or copied.  The io variant reads the stream to its end. */
+bool json_validate(const char *buf, size_t len);
+bool json_validate_io(json_io_t io, void *user);
+
+void json_validator_init(json_validator_t *v);
+bool json_validator_feed(json_validator_t *v, const char *buf, size_t len);
+/* Call once the input is exhausted; a number may still be open until then. */
+bool json_validator_finish(json_validator_t *v);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef JSON_IMPLEMENTATION
+#include "json.c"
+#endif
 
 #endif // JSON_H
@@ -0,0 +1,326 @@
+#ifndef JSON_HPP
+#define JSON_HPP
+
+/* C++17 front-end: describe a struct's members once and get read/write for
+ * it, nested structs, std::array, std::vector and strings.
+ *
+ *   struct point { int32_t x, y; };
+ *
+ *   template<> struct jsoon::meta<point>
+ *   {
+ *   	static constexpr auto members = jsoon::members(
+ *   		jsoon::field("x", &point::x),
+ *   		jsoon::field("y", &point::y));
+ *   };
+ *
+ * Members are read & written in declaration order, as the C API expects.
+ * jsoon::count("n", &obj::points) writes the size of a vector member and, on
+ * read, reserves that many elements before the vector itself is read.  As the
+ * count comes from the input, the reservation stops at reserve_max bytes and
+ * the vector grows as usual past that. */
+
+#include "json.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace jsoon {
+
+template<typename T>
+struct meta;
+
+constexpr std::size_t reserve_max = std::size_t(1) << 20;
+
+template<typename T, typename M>
+struct field_t
+{
+	const char *label;
+	M T::*ptr;
+};
+
+template<typename T, typename V>
+struct count_t
+{
+	const char *label;
+	V T::*ptr;
+};
+
+template<typename T, typename M>
+constexpr field_t<T, M> field(const char *label, M T::*ptr)
+{
+	return { label, ptr };
+}
+
+template<typename T, typename V>
+constexpr count_t<T, V> count(const char *label, V T::*ptr)
+{
+	return { label, ptr };
+}
+
+template<typename... Ms>
+constexpr std::tuple<Ms...> members(Ms... ms)
+{
+	return std::tuple<Ms...>(ms...);
+}
+
+namespace detail {
+
+template<typename T>
+struct always_false : std::false_type {};
+
+template<typename T, typename = void>
+struct has_meta : std::false_type {};
+
+template<typename T>
+struct has_meta<T, std::void_t<decltype(meta<T>::members)>> : std::true_type {};
+
+template<typename T>
+struct is_array : std::false_type {};
+
+template<typename T, std::size_t N>
+struct is_array<std::array<T, N>> : std::true_type {};
+
+template<typename T>
+struct is_vector : std::false_type {};
+
+template<typename T, typename A>
+struct is_vector<std::vector<T, A>> : std::true_type {};
+
+/* Holds the json_obj_t of an object/array being read or written & puts
+ * json->cur back when it goes out of scope.  After a successful end call
+ * that is a no-op; after a failure it keeps json->cur from pointing at an
+ * object that no longer exists (json_get_error walks that chain). */
+struct frame
+{
+	json_t *json;
+	json_obj_t *cur;
+	std::size_t indent;
+	json_obj_t obj;
+
+	explicit frame(json_t *json) : json(json), cur(json->cur), indent(json->indent) {}
+	frame(const frame &) = delete;
+	frame &operator=(const frame &) = delete;
+	~frame()
+	{
+		json->cur = cur;
+		json->indent = indent;
+	}
+};
+
+/* Reads through the fixed-width type of the C API & assigns, as T may be
+ * a distinct type of the same size (e.g. long vs. long long). */
+template<typename F, typename T>
+bool read_as(bool (*read)(json_t *, const char *, F *), json_t *json, const char *label, T &val)
+{
+	F v;
+	if (!read(json, label, &v))
+		return false;
+	val = static_cast<T>(v);
+	return true;
+}
+
+template<typename T>
+bool write_value(json_t *json, const char *label, const T &val);
+
+template<typename T>
+bool read_value(json_t *json, const char *label, T &val);
+
+template<typename T, typename M>
+bool write_member(json_t *json, const T &obj, const field_t<T, M> &m)
+{
+	return write_value(json, m.label, obj.*m.ptr);
+}
+
+template<typename T, typename V>
+bool write_member(json_t *json, const T &obj, const count_t<T, V> &m)
+{
+	return json_write_uint64(json, m.label, (obj.*m.ptr).size());
+}
+
+template<typename T, typename M>
+bool read_member(json_t *json, T &obj, const field_t<T, M> &m)
+{
+	return read_value(json, m.label, obj.*m.ptr);
+}
+
+template<typename T, typename V>
+bool read_member(json_t *json, T &obj, const count_t<T, V> &m)
+{
+	uint64_t n;
+	if (!json_read_uint64(json, m.label, &n))
+		return false;
+	constexpr std::size_t max = reserve_max / sizeof(typename V::value_type);
+	(obj.*m.ptr).clear();
+	(obj.*m.ptr).reserve(n < max ? std::size_t(n) : max);
+	return true;
+}
+
+template<typename T>
+bool write_object(json_t *json, const char *label, const T &obj)
+{
+	frame f(json);
+	return json_write_object_begin(json, label, &f.obj)
+	    && std::apply([&](const auto &... m) { return (write_member(json, obj, m) && ...); },
+	                  meta<T>::members)
+	    && json_write_object_end(json);
+}
+
+template<typename T>
+bool read_object(json_t *json, const char *label, T &obj)
+{
+	frame f(json);
+	return json_read_object_begin(json, label, &f.obj)
+	    && std::apply([&](const auto &... m) { return (read_member(json, obj, m) && ...); },
+	                  meta<T>::members)
+	    && json_read_object_end(json);
+}
+
+template<typename C>
+bool write_elements(json_t *json, const char *label, const C &c)
+{
+	frame f(json);
+	if (!json_write_array_begin(json, label, &f.obj))
+		return false;
+	for (const auto &v : c)
+		if (!write_value(json, "", v))
+			return false;
+	return json_write_array_end(json);
+}
+
+inline
+bool read_string(json_t *json, const char *label, std::string &val)
+{
+	std::size_t len = 0;
+	bool more = false;
+	val.resize(val.capacity() > 16 ? val.capacity() : 16);
+	do {
+		if (more)
+			val.resize(val.size() * 2);
+		if (!json_read_str_part(json, label, &val[0], val.size(), &len, &more))
+			return false;
+	} while (more);
+	val.resize(len);
+	return true;
+}
+
+template<typename T>
+bool write_value(json_t *json, const char *label, const T &val)
+{
+	if constexpr (std::is_same_v<T, bool>) {
+		return json_write_bool(json, label, val);
+	} else if constexpr (std::is_same_v<T, char>) {
+		return json_write_char(json, label, val);
+	} else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+		if constexpr (sizeof(T) <= 2)
+			return json_write_int16(json, label, val);
+		else if constexpr (sizeof(T) <= 4)
+			return json_write_int32(json, label, val);
+		else
+			return json_write_int64(json, label, val);
+	} else if constexpr (std::is_integral_v<T>) {
+		if constexpr (sizeof(T) <= 2)
+			return json_write_uint16(json, label, val);
+		else if constexpr (sizeof(T) <= 4)
+			return json_write_uint32(json, label, val);
+		else
+			return json_write_uint64(json, label, val);
+	} else if constexpr (std::is_same_v<T, float>) {
+		return json_write_float(json, label, val);
+	} else if constexpr (std::is_same_v<T, double>) {
+		return json_write_double(json, label, val);
+	} else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+		return json_write_strn_escaped(json, label, val.data(), val.size());
+	} else if constexpr (is_array<T>::value || is_vector<T>::value) {
+		return write_elements(json, label, val);
+	} else if constexpr (has_meta<T>::value) {
+		return write_object(json, label, val);
+	} else {
+		static_assert(always_false<T>::value, "type has no jsoon::meta specialization");
+		return false;
+	}
+}
+
+template<typename T>
+bool read_value(json_t *json, const char *label, T &val)
+{
+	if constexpr (std::is_same_v<T, bool>) {
+		return json_read_bool(json, label, &val);
+	} else if constexpr (std::is_same_v<T, char>) {
+		return json_read_char(json, label, &val);
+	} else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+		if constexpr (sizeof(T) == 1)
+			return read_as(json_read_int8, json, label, val);
+		else if constexpr (sizeof(T) == 2)
+			return read_as(json_read_int16, json, label, val);
+		else if constexpr (sizeof(T) == 4)
+			return read_as(json_read_int32, json, label, val);
+		else
+			return read_as(json_read_int64, json, label, val);
+	} else if constexpr (std::is_integral_v<T>) {
+		if constexpr (sizeof(T) == 1)
+			return read_as(json_read_uint8, json, label, val);
+		else if constexpr (sizeof(T) == 2)
+			return read_as(json_read_uint16, json, label, val);
+		else if constexpr (sizeof(T) == 4)
+			return read_as(json_read_uint32, json, label, val);
+		else
+			return read_as(json_read_uint64, json, label, val);
+	} else if constexpr (std::is_same_v<T, float>) {
+		return json_read_float(json, label, &val);
+	} else if constexpr (std::is_same_v<T, double>) {
+		return json_read_double(json, label, &val);
+	} else if constexpr (std::is_same_v<T, std::string>) {
+		return read_string(json, label, val);
+	} else if constexpr (std::is_same_v<T, std::string_view>) {
+		static_assert(always_false<T>::value, "std::string_view can be written but not read");
+		return false;
+	} else if constexpr (is_array<T>::value) {
+		frame f(json);
+		if (!json_read_array_begin(json, label, &f.obj))
+			return false;
+		for (auto &v : val)
+			if (!read_value(json, "", v))
+				return false;
+		return json_read_array_end(json);
+	} else if constexpr (is_vector<T>::value) {
+		frame f(json);
+		if (!json_read_array_begin(json, label, &f.obj))
+			return false;
+		val.clear();
+		while (!json_peek_array_end(json))
+			if (!read_value(json, "", val.emplace_back()))
+				return false;
+		return json_read_array_end(json);
+	} else if constexpr (has_meta<T>::value) {
+		return read_object(json, label, val);
+	} else {
+		static_assert(always_false<T>::value, "type has no jsoon::meta specialization");
+		return false;
+	}
+}
+
+} // namespace detail
+
+/* Root-level entry points; `label` only matters inside another object. */
+
+template<typename T>
+bool write(json_t *json, const T &val, const char *label = "root")
+{
+	return detail::write_value(json, label, val);
+}
+
+template<typename T>
+bool read(json_t *json, T &val, const char *label = "root")
+{
+	return detail::read_value(json, label, val);
+}
+
+} // namespace jsoon
+
+#endif // JSON_HPP
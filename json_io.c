@@ -0,0 +1,553 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "json_io.h"
+
+#define json__min(a, b) ((a) < (b) ? (a) : (b))
+
+/* helpers */
+
+static
+int json__write_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		const ssize_t n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		buf += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+/* async writer */
+
+static
+void *json__async_main(void *arg)
+{
+	json_async_t *a = arg;
+	pthread_mutex_lock(&a->lock);
+	for (;;) {
+		while (a->written == a->filled && !a->done)
+			pthread_cond_wait(&a->cond, &a->lock);
+		if (a->written == a->filled)
+			break;
+		const size_t i = a->written % JSON_ASYNC_BUFFERS;
+		const int prev = a->err;
+		pthread_mutex_unlock(&a->lock);
+
+		/* after a failure the rest is dropped, so the file ends at a
+		 * buffer boundary rather than having a hole in it */
+		const int err = prev ? prev : json__write_all(a->fd, a->bufs[i], a->lens[i]);
+
+		pthread_mutex_lock(&a->lock);
+		a->err = err;
+		++a->written;
+		pthread_cond_broadcast(&a->cond);
+	}
+	pthread_mutex_unlock(&a->lock);
+	return NULL;
+}
+
+/* Queues the current buffer & waits until the next one is free. */
+static
+bool json__async_flush(json_async_t *a)
+{
+	pthread_mutex_lock(&a->lock);
+	a->lens[a->filled % JSON_ASYNC_BUFFERS] = a->pos;
+	++a->filled;
+	pthread_cond_broadcast(&a->cond);
+	while (a->filled - a->written >= JSON_ASYNC_BUFFERS)
+		pthread_cond_wait(&a->cond, &a->lock);
+	const bool ok = a->err == 0;
+	pthread_mutex_unlock(&a->lock);
+	a->pos = 0;
+	return ok;
+}
+
+static
+size_t json__async_fwrite(const void *ptr, size_t size, size_t nmemb, void *user)
+{
+	json_async_t *a = user;
+	const char *src = ptr;
+	size_t n = size * nmemb;
+	while (n > 0) {
+		if (a->pos == a->size && !json__async_flush(a))
+			return 0;
+		const size_t len = json__min(n, a->size - a->pos);
+		memcpy(&a->bufs[a->filled % JSON_ASYNC_BUFFERS][a->pos], src, len);
+		a->pos += len;
+		src += len;
+		n -= len;
+	}
+	return nmemb;
+}
+
+static
+int json__async_fputc(int c, void *user)
+{
+	json_async_t *a = user;
+	if (a->pos == a->size && !json__async_flush(a))
+		return EOF;
+	a->bufs[a->filled % JSON_ASYNC_BUFFERS][a->pos++] = (char)c;
+	return (unsigned char)c;
+}
+
+static
+int json__async_finish(void *user)
+{
+	json_async_t *a = user;
+	if (a->done)
+		return a->err ? EOF : 0;
+	if (a->pos > 0)
+		json__async_flush(a);
+	pthread_mutex_lock(&a->lock);
+	a->done = true;
+	pthread_cond_broadcast(&a->cond);
+	pthread_mutex_unlock(&a->lock);
+	pthread_join(a->thread, NULL);
+	pthread_cond_destroy(&a->cond);
+	pthread_mutex_destroy(&a->lock);
+	return a->err ? EOF : 0;
+}
+
+static const json_io_t g_json_io_async = {
+	.fwrite = json__async_fwrite,
+	.fputc  = json__async_fputc,
+	.finish = json__async_finish,
+};
+
+bool json_init_async(json_t *json, json_async_t *async, int fd, void *buf, size_t size)
+{
+	json_async_t *a = async;
+	assert(size >= JSON_ASYNC_BUFFERS);
+	memset(a, 0, sizeof(*a));
+	a->fd = fd;
+	a->size = size / JSON_ASYNC_BUFFERS;
+	for (size_t i = 0; i < JSON_ASYNC_BUFFERS; ++i)
+		a->bufs[i] = (char *)buf + i * a->size;
+	if (pthread_mutex_init(&a->lock, NULL) != 0)
+		return false;
+	if (pthread_cond_init(&a->cond, NULL) != 0) {
+		pthread_mutex_destroy(&a->lock);
+		return false;
+	}
+	if (pthread_create(&a->thread, NULL, json__async_main, a) != 0) {
+		pthread_cond_destroy(&a->cond);
+		pthread_mutex_destroy(&a->lock);
+		return false;
+	}
+	json_init(json, g_json_io_async, a);
+	return true;
+}
+
+/* prefetching reader */
+
+#define json__load(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define json__store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/* Wakes the other side once a counter or flag has been published.  Taking
+ * the lock orders this after a sleeper's check, so no wakeup is lost. */
+static
+void json__prefetch_wake(json_prefetch_t *pf)
+{
+	pthread_mutex_lock(&pf->lock);
+	pthread_cond_broadcast(&pf->cond);
+	pthread_mutex_unlock(&pf->lock);
+}
+
+static
+uint64_t json__now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static
+void *json__prefetch_main(void *arg)
+{
+	json_prefetch_t *pf = arg;
+	for (uint64_t filled = 0;; ++filled) {
+		if (filled - json__load(&pf->consumed) >= JSON_PREFETCH_BLOCKS) {
+			++pf->full_waits;
+			pthread_mutex_lock(&pf->lock);
+			while (filled - json__load(&pf->consumed) >= JSON_PREFETCH_BLOCKS && !json__load(&pf->stop))
+				pthread_cond_wait(&pf->cond, &pf->lock);
+			pthread_mutex_unlock(&pf->lock);
+		}
+		if (json__load(&pf->stop))
+			break;
+
+		const size_t i = filled % JSON_PREFETCH_BLOCKS;
+		size_t len = 0, n;
+		/* fill the whole block; a source may hand out less than asked for */
+		while (len < pf->size && (n = pf->io.fread(pf->bufs[i] + len, 1, pf->size - len, pf->user)) > 0)
+			len += n;
+		if (len == 0)
+			break;
+		pf->lens[i] = len;
+		json__store(&pf->filled, filled + 1);
+		json__prefetch_wake(pf);
+	}
+	json__store(&pf->eof, true);
+	json__prefetch_wake(pf);
+	return NULL;
+}
+
+/* Moves on to the next block once the current one is used up; false at the
+ * end of the input. */
+static
+bool json__prefetch_next(json_prefetch_t *pf)
+{
+	const size_t i = pf->consumed % JSON_PREFETCH_BLOCKS;
+	if (json__load(&pf->filled) > pf->consumed) {
+		if (pf->pos < pf->lens[i])
+			return true;
+		pf->offset += pf->lens[i];
+		pf->pos = 0;
+		json__store(&pf->consumed, pf->consumed + 1);
+		json__prefetch_wake(pf);
+	}
+	if (json__load(&pf->filled) > pf->consumed)
+		return true;
+
+	const uint64_t start = json__now_ns();
+	++pf->stalls;
+	pthread_mutex_lock(&pf->lock);
+	while (json__load(&pf->filled) == pf->consumed && !json__load(&pf->eof))
+		pthread_cond_wait(&pf->cond, &pf->lock);
+	pthread_mutex_unlock(&pf->lock);
+	pf->stall_ns += json__now_ns() - start;
+	/* eof is published after the last block */
+	return json__load(&pf->filled) > pf->consumed;
+}
+
+static
+int json__prefetch_fgetc(void *user)
+{
+	json_prefetch_t *pf = user;
+	if (!json__prefetch_next(pf))
+		return EOF;
+	return (unsigned char)pf->bufs[pf->consumed % JSON_PREFETCH_BLOCKS][pf->pos++];
+}
+
+static
+size_t json__prefetch_fread(void *ptr, size_t size, size_t nmemb, void *user)
+{
+	json_prefetch_t *pf = user;
+	char *dst = ptr;
+	size_t n = size * nmemb, done = 0;
+	while (done < n && json__prefetch_next(pf)) {
+		const size_t i = pf->consumed % JSON_PREFETCH_BLOCKS;
+		const size_t len = json__min(n - done, pf->lens[i] - pf->pos);
+		memcpy(dst + done, &pf->bufs[i][pf->pos], len);
+		pf->pos += len;
+		done += len;
+	}
+	return size ? done / size : 0;
+}
+
+static
+long json__prefetch_ftell(void *user)
+{
+	json_prefetch_t *pf = user;
+	return (long)(pf->offset + pf->pos);
+}
+
+static
+int json__prefetch_finish(void *user)
+{
+	json_prefetch_t *pf = user;
+	if (pf->joined)
+		return 0;
+	json__store(&pf->stop, true);
+	json__prefetch_wake(pf);
+	pthread_join(pf->thread, NULL);
+	pthread_cond_destroy(&pf->cond);
+	pthread_mutex_destroy(&pf->lock);
+	pf->joined = true;
+	return 0;
+}
+
+static const json_io_t g_json_io_prefetch = {
+	.fgetc  = json__prefetch_fgetc,
+	.fread  = json__prefetch_fread,
+	.ftell  = json__prefetch_ftell,
+	.finish = json__prefetch_finish,
+};
+
+bool json_init_prefetch(json_t *json, json_prefetch_t *prefetch, json_io_t io, void *user,
+                        void *buf, size_t size)
+{
+	json_prefetch_t *pf = prefetch;
+	assert(size >= JSON_PREFETCH_BLOCKS);
+	memset(pf, 0, sizeof(*pf));
+	pf->io = io;
+	pf->user = user;
+	pf->size = size / JSON_PREFETCH_BLOCKS;
+	for (size_t i = 0; i < JSON_PREFETCH_BLOCKS; ++i)
+		pf->bufs[i] = (char *)buf + i * pf->size;
+	if (pthread_mutex_init(&pf->lock, NULL) != 0)
+		return false;
+	if (pthread_cond_init(&pf->cond, NULL) != 0) {
+		pthread_mutex_destroy(&pf->lock);
+		return false;
+	}
+	if (pthread_create(&pf->thread, NULL, json__prefetch_main, pf) != 0) {
+		pthread_cond_destroy(&pf->cond);
+		pthread_mutex_destroy(&pf->lock);
+		return false;
+	}
+	json_init(json, g_json_io_prefetch, pf);
+	return true;
+}
+
+/* mmap sink */
+
+/* Remaps the file with room for at least n more bytes. */
+static
+bool json__mmap_grow(json_mmap_t *m, size_t n)
+{
+	if (m->err)
+		return false;
+	size_t cap = m->cap + m->extent;
+	while (cap - m->pos < n)
+		cap += m->extent;
+	if (m->base && munmap(m->base, m->cap) != 0)
+		goto fail;
+	m->base = NULL;
+	/* posix_fallocate reserves the blocks too, so running out of space is
+	 * reported here rather than as SIGBUS when the page is touched */
+	if (   (errno = posix_fallocate(m->fd, 0, (off_t)cap)) != 0
+	    && ((errno != EINVAL && errno != EOPNOTSUPP) || ftruncate(m->fd, (off_t)cap) != 0))
+		goto fail;
+	void *base = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd, 0);
+	if (base == MAP_FAILED)
+		goto fail;
+	m->base = base;
+	m->cap = cap;
+	return true;
+
+fail:
+	m->err = errno;
+	m->cap = 0;
+	return false;
+}
+
+static
+size_t json__mmap_fwrite(const void *ptr, size_t size, size_t nmemb, void *user)
+{
+	json_mmap_t *m = user;
+	const size_t n = size * nmemb;
+	/* a failed grow leaves no mapping behind, whatever pos says */
+	if (m->err || (m->cap - m->pos < n && !json__mmap_grow(m, n)))
+		return 0;
+	memcpy(&m->base[m->pos], ptr, n);
+	m->pos += n;
+	return nmemb;
+}
+
+static
+int json__mmap_fputc(int c, void *user)
+{
+	json_mmap_t *m = user;
+	if (m->err || (m->pos == m->cap && !json__mmap_grow(m, 1)))
+		return EOF;
+	m->base[m->pos++] = (char)c;
+	return (unsigned char)c;
+}
+
+static
+long json__mmap_ftell(void *user)
+{
+	json_mmap_t *m = user;
+	return (long)m->pos;
+}
+
+static
+int json__mmap_finish(void *user)
+{
+	json_mmap_t *m = user;
+	if (m->base) {
+		if (munmap(m->base, m->cap) != 0 && !m->err)
+			m->err = errno;
+		m->base = NULL;
+	}
+	if (ftruncate(m->fd, (off_t)m->pos) != 0 && !m->err)
+		m->err = errno;
+	m->cap = 0;
+	return m->err ? EOF : 0;
+}
+
+static const json_io_t g_json_io_mmap = {
+	.fwrite = json__mmap_fwrite,
+	.fputc  = json__mmap_fputc,
+	.ftell  = json__mmap_ftell,
+	.finish = json__mmap_finish,
+};
+
+bool json_init_mmap(json_t *json, json_mmap_t *map, int fd, size_t extent)
+{
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	memset(map, 0, sizeof(*map));
+	map->fd = fd;
+	map->extent = ((extent ? extent : JSON_MMAP_EXTENT) + page - 1) / page * page;
+	if (ftruncate(fd, 0) != 0) {
+		map->err = errno;
+		return false;
+	}
+	json_init(json, g_json_io_mmap, map);
+	return true;
+}
+
+/* atomic save */
+
+static
+bool json__save_fail(json_save_t *save)
+{
+	save->err = errno;
+	json_save_abort(save);
+	return false;
+}
+
+static pthread_once_t g_json_umask_once = PTHREAD_ONCE_INIT;
+static mode_t g_json_umask;
+
+/* The umask can only be read by setting it, for the whole process, so that
+ * happens once rather than on every save racing other threads' files. */
+static
+void json__read_umask(void)
+{
+	g_json_umask = umask(0);
+	umask(g_json_umask);
+}
+
+/* fsyncs the directory holding `path`, so the rename itself is durable */
+static
+int json__sync_dir(const char *path)
+{
+	char dir[JSON_SAVE_PATH];
+	const char *slash = strrchr(path, '/');
+	if (slash == NULL) {
+		strcpy(dir, ".");
+	} else if (slash == path) {
+		strcpy(dir, "/");
+	} else {
+		memcpy(dir, path, slash - path);
+		dir[slash - path] = 0;
+	}
+	const int fd = open(dir, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	const int ret = fsync(fd);
+	close(fd);
+	return ret;
+}
+
+bool json_save_begin(json_t *json, json_save_t *save, const char *path, size_t size_hint,
+                     void *buf, size_t buf_size)
+{
+	struct stat st;
+	mode_t mode;
+	int fd;
+
+	memset(save, 0, sizeof(*save));
+	if (strlen(path) + sizeof(".XXXXXX") > JSON_SAVE_PATH) {
+		save->err = ENAMETOOLONG;
+		return false;
+	}
+	strcpy(save->path, path);
+	strcpy(save->tmp, path);
+	strcat(save->tmp, ".XXXXXX");
+
+	if (stat(path, &st) == 0) {
+		mode = st.st_mode & 07777;
+		if (size_hint == 0)
+			size_hint = (size_t)st.st_size;
+	} else {
+		/* mkstemp uses 0600; a fresh file gets what open(2) would give it */
+		pthread_once(&g_json_umask_once, json__read_umask);
+		mode = 0666 & ~g_json_umask;
+	}
+
+	if ((fd = mkstemp(save->tmp)) < 0) {
+		save->err = errno;
+		save->tmp[0] = 0;
+		return false;
+	}
+	if ((save->fp = fdopen(fd, "wb")) == NULL) {
+		save->err = errno;
+		close(fd);
+		unlink(save->tmp);
+		save->tmp[0] = 0;
+		return false;
+	}
+	if (fchmod(fd, mode) != 0)
+		return json__save_fail(save);
+
+	/* one contiguous reservation instead of growing by every flush; the
+	 * file is trimmed back to what was written on commit */
+	if (size_hint > 0 && (errno = posix_fallocate(fd, 0, (off_t)size_hint)) != 0
+	    && errno != EINVAL && errno != EOPNOTSUPP)
+		return json__save_fail(save);
+
+	if (buf && setvbuf(save->fp, buf, _IOFBF, buf_size) != 0)
+		return json__save_fail(save);
+
+	json_init_file(json, save->fp);
+	return true;
+}
+
+bool json_save_commit(json_t *json, json_save_t *save)
+{
+	/* an earlier step failed & aborted, or this save was committed already */
+	if (save->fp == NULL) {
+		if (save->err == 0)
+			save->err = EINVAL;
+		return false;
+	}
+	const int fd = fileno(save->fp);
+	if (!json_finish(json))
+		return json__save_fail(save);
+	const off_t size = ftello(save->fp);
+	if (   size < 0
+	    || ftruncate(fd, size) != 0
+	    || fsync(fd) != 0)
+		return json__save_fail(save);
+	const int ret = fclose(save->fp);
+	save->fp = NULL;
+	if (ret != 0 || rename(save->tmp, save->path) != 0)
+		return json__save_fail(save);
+	save->tmp[0] = 0;
+	if (json__sync_dir(save->path) != 0) {
+		/* the new contents are in place, only their durability is unknown */
+		save->err = errno;
+		return false;
+	}
+	return true;
+}
+
+void json_save_abort(json_save_t *save)
+{
+	if (save->fp) {
+		fclose(save->fp);
+		save->fp = NULL;
+	}
+	if (save->tmp[0]) {
+		unlink(save->tmp);
+		save->tmp[0] = 0;
+	}
+}
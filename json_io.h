@@ -0,0 +1,123 @@
+#ifndef JSON_IO_H
+#define JSON_IO_H
+
+/* POSIX backends.  Compile json_io.c next to json.c and link with -pthread. */
+
+#include "json.h"
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef JSON_SAVE_PATH
+#define JSON_SAVE_PATH 4096
+#endif
+
+/* Default growth step of the memory-mapped sink. */
+#ifndef JSON_MMAP_EXTENT
+#define JSON_MMAP_EXTENT (64 << 20)
+#endif
+
+#ifndef JSON_ASYNC_BUFFERS
+#define JSON_ASYNC_BUFFERS 2
+#endif
+
+/* Write-only backend: the caller's buffer is split into JSON_ASYNC_BUFFERS
+ * parts, one of which is filled while a background thread write(2)s the
+ * others to `fd` in order.  json_finish waits for the thread & reports the
+ * first write error, which is also left in `err`.  The fd stays open. */
+typedef struct json_async
+{
+	int fd;
+	int err;              /* errno of the first failed write, or 0 */
+	/* internal */
+	char *bufs[JSON_ASYNC_BUFFERS];
+	size_t lens[JSON_ASYNC_BUFFERS];
+	size_t size, pos;     /* per-buffer capacity & fill of the current one */
+	uint64_t filled;      /* buffers handed to the writer */
+	uint64_t written;     /* buffers the writer is done with */
+	bool done;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} json_async_t;
+
+bool json_init_async(json_t *json, json_async_t *async, int fd, void *buf, size_t size);
+
+#ifndef JSON_PREFETCH_BLOCKS
+#define JSON_PREFETCH_BLOCKS 4
+#endif
+
+/* Read-only backend for slow or decompressing sources: a background thread
+ * reads the wrapped `io` ahead into the caller's buffer, split into
+ * JSON_PREFETCH_BLOCKS blocks that form a lock-free single-producer/single-
+ * consumer ring, so the parser only reads memory that is already filled.
+ * Call json_finish once done reading to stop & join the thread. */
+typedef struct json_prefetch
+{
+	json_io_t io;         /* the wrapped source */
+	void *user;
+	uint64_t stalls;      /* times the parser found the ring empty */
+	uint64_t stall_ns;    /* & the time it spent waiting for data */
+	uint64_t full_waits;  /* times the reader thread found the ring full */
+	/* internal */
+	char *bufs[JSON_PREFETCH_BLOCKS];
+	size_t lens[JSON_PREFETCH_BLOCKS];
+	size_t size, pos;     /* block capacity & position in the current block */
+	uint64_t offset;      /* bytes consumed before the current block */
+	uint64_t filled;      /* blocks published by the reader thread */
+	uint64_t consumed;    /* blocks the parser is done with */
+	bool eof, stop, joined;
+	pthread_t thread;
+	pthread_mutex_t lock; /* only taken to sleep & wake, never to pass data */
+	pthread_cond_t cond;
+} json_prefetch_t;
+
+bool json_init_prefetch(json_t *json, json_prefetch_t *prefetch, json_io_t io, void *user,
+                        void *buf, size_t size);
+
+/* Write-only backend that writes straight into a shared mapping of `fd`,
+ * growing the file & the mapping `extent` bytes at a time (0 for
+ * JSON_MMAP_EXTENT).  The file is truncated first and json_finish trims it
+ * to the bytes written. */
+typedef struct json_mmap
+{
+	int fd;
+	int err; /* errno of the first failed ftruncate/mmap, or 0 */
+	/* internal */
+	char *base;
+	size_t pos, cap, extent;
+} json_mmap_t;
+
+bool json_init_mmap(json_t *json, json_mmap_t *map, int fd, size_t extent);
+
+/* Crash-safe save: output goes to a temporary file next to `path`, which
+ * json_save_commit flushes, fsyncs & renames over `path` in one step.  The
+ * temporary is preallocated to `size_hint` bytes, or to the size of the
+ * file being replaced when the hint is 0.  `buf` (may be NULL) becomes the
+ * stdio buffer, so a few MiB keeps the number of writes down.  A new file
+ * gets 0666 less the umask, which the first such save reads (by briefly
+ * setting it) & later ones assume unchanged. */
+typedef struct json_save
+{
+	FILE *fp;
+	int err; /* errno of the step that failed */
+	char path[JSON_SAVE_PATH];
+	char tmp[JSON_SAVE_PATH];
+} json_save_t;
+
+bool json_save_begin(json_t *json, json_save_t *save, const char *path, size_t size_hint,
+                     void *buf, size_t buf_size);
+/* Also fails, keeping `err`, after json_save_begin or an earlier commit
+ * failed, which have already discarded the temporary. */
+bool json_save_commit(json_t *json, json_save_t *save);
+/* Discards the temporary file; `path` is left untouched. */
+void json_save_abort(json_save_t *save);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_IO_H
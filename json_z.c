@@ -0,0 +1,316 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include "json_z.h"
+
+#define json__min(a, b) ((a) < (b) ? (a) : (b))
+
+/* helpers */
+
+static
+bool json__zfile_put(json_zfile_t *z, size_t n)
+{
+	if (n > 0 && fwrite(z->packed, 1, n, z->fp) != n) {
+		z->err = "write failed";
+		return false;
+	}
+	return true;
+}
+
+/* gzip */
+
+static
+const char *json__gz_error(z_stream *s, int ret)
+{
+	return s->msg ? s->msg : zError(ret);
+}
+
+/* Compresses the plain buffer out to the file; `end` closes the stream. */
+static
+bool json__gz_pack(json_zfile_t *z, bool end)
+{
+	z_stream *s = &z->codec.gz;
+	int ret;
+	s->next_in = (Bytef *)z->plain;
+	s->avail_in = (uInt)z->len;
+	do {
+		s->next_out = (Bytef *)z->packed;
+		s->avail_out = (uInt)z->size;
+		ret = deflate(s, end ? Z_FINISH : Z_NO_FLUSH);
+		if (ret == Z_STREAM_ERROR) {
+			z->err = json__gz_error(s, ret);
+			return false;
+		}
+		if (!json__zfile_put(z, z->size - s->avail_out))
+			return false;
+	} while (end ? ret != Z_STREAM_END : s->avail_out == 0);
+	return true;
+}
+
+/* Decompresses what it can of the packed buffer into the plain one. */
+static
+bool json__gz_unpack(json_zfile_t *z)
+{
+	z_stream *s = &z->codec.gz;
+	if (z->ended) {
+		/* another member follows, as with `cat a.gz b.gz` */
+		if (inflateReset(s) != Z_OK) {
+			z->err = json__gz_error(s, Z_STREAM_ERROR);
+			return false;
+		}
+		z->ended = false;
+	}
+	s->next_in = (Bytef *)&z->packed[z->in_pos];
+	s->avail_in = (uInt)(z->in_len - z->in_pos);
+	s->next_out = (Bytef *)z->plain;
+	s->avail_out = (uInt)z->size;
+	const int ret = inflate(s, Z_NO_FLUSH);
+	z->in_pos = z->in_len - s->avail_in;
+	z->len = z->size - s->avail_out;
+	if (ret == Z_STREAM_END) {
+		z->ended = true;
+	} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+		z->err = json__gz_error(s, ret);
+		return false;
+	}
+	return true;
+}
+
+/* zstd */
+
+#if JSON_ZSTD
+static
+bool json__zstd_pack(json_zfile_t *z, bool end)
+{
+	ZSTD_inBuffer in = { z->plain, z->len, 0 };
+	size_t ret;
+	do {
+		ZSTD_outBuffer out = { z->packed, z->size, 0 };
+		ret = ZSTD_compressStream2(z->codec.cctx, &out, &in, end ? ZSTD_e_end : ZSTD_e_continue);
+		if (ZSTD_isError(ret)) {
+			z->err = ZSTD_getErrorName(ret);
+			return false;
+		}
+		if (!json__zfile_put(z, out.pos))
+			return false;
+	} while (end ? ret != 0 : in.pos < in.size);
+	return true;
+}
+
+/* Successive frames need no reset: the context starts the next one itself. */
+static
+bool json__zstd_unpack(json_zfile_t *z)
+{
+	ZSTD_inBuffer in = { z->packed, z->in_len, z->in_pos };
+	ZSTD_outBuffer out = { z->plain, z->size, 0 };
+	const size_t ret = ZSTD_decompressStream(z->codec.dctx, &out, &in);
+	if (ZSTD_isError(ret)) {
+		z->err = ZSTD_getErrorName(ret);
+		return false;
+	}
+	z->in_pos = in.pos;
+	z->len = out.pos;
+	z->ended = ret == 0;
+	return true;
+}
+#endif
+
+/* backend */
+
+static
+bool json__zfile_pack(json_zfile_t *z, bool end)
+{
+	bool ok;
+	if (z->err)
+		return false;
+#if JSON_ZSTD
+	if (z->zstd)
+		ok = json__zstd_pack(z, end);
+	else
+#endif
+		ok = json__gz_pack(z, end);
+	z->offset += z->len;
+	z->len = 0;
+	return ok;
+}
+
+/* Refills the plain buffer once it has been consumed. */
+static
+bool json__zfile_fill(json_zfile_t *z)
+{
+	while (z->pos == z->len) {
+		/* a full buffer may have left output inside the codec */
+		const bool pending = z->len == z->size && !z->ended;
+		if (z->eof || z->err)
+			return false;
+		z->offset += z->len;
+		z->pos = z->len = 0;
+		if (z->in_pos == z->in_len && !pending) {
+			z->in_pos = 0;
+			z->in_len = fread(z->packed, 1, z->size, z->fp);
+			if (z->in_len == 0) {
+				if (ferror(z->fp))
+					z->err = "read failed";
+				else if (!z->ended)
+					z->err = "truncated stream";
+				z->eof = true;
+				return false;
+			}
+		}
+#if JSON_ZSTD
+		if (z->zstd) {
+			if (!json__zstd_unpack(z))
+				return false;
+			continue;
+		}
+#endif
+		if (!json__gz_unpack(z))
+			return false;
+	}
+	return true;
+}
+
+static
+int json__zfile_fgetc(void *user)
+{
+	json_zfile_t *z = user;
+	if (!json__zfile_fill(z))
+		return EOF;
+	return (unsigned char)z->plain[z->pos++];
+}
+
+static
+size_t json__zfile_fread(void *ptr, size_t size, size_t nmemb, void *user)
+{
+	json_zfile_t *z = user;
+	char *dst = ptr;
+	size_t n = size * nmemb, done = 0;
+	while (done < n && json__zfile_fill(z)) {
+		const size_t len = json__min(n - done, z->len - z->pos);
+		memcpy(dst + done, &z->plain[z->pos], len);
+		z->pos += len;
+		done += len;
+	}
+	return size ? done / size : 0;
+}
+
+static
+size_t json__zfile_fwrite(const void *ptr, size_t size, size_t nmemb, void *user)
+{
+	json_zfile_t *z = user;
+	const char *src = ptr;
+	size_t n = size * nmemb;
+	while (n > 0) {
+		if (z->len == z->size && !json__zfile_pack(z, false))
+			return 0;
+		const size_t len = json__min(n, z->size - z->len);
+		memcpy(&z->plain[z->len], src, len);
+		z->len += len;
+		src += len;
+		n -= len;
+	}
+	return nmemb;
+}
+
+static
+int json__zfile_fputc(int c, void *user)
+{
+	json_zfile_t *z = user;
+	if (z->len == z->size && !json__zfile_pack(z, false))
+		return EOF;
+	z->plain[z->len++] = (char)c;
+	return (unsigned char)c;
+}
+
+/* Position in the plain document. */
+static
+long json__zfile_ftell(void *user)
+{
+	json_zfile_t *z = user;
+	return (long)(z->offset + (z->write ? z->len : z->pos));
+}
+
+static
+int json__zfile_finish(void *user)
+{
+	json_zfile_t *z = user;
+	if (z->done)
+		return z->err ? EOF : 0;
+	if (   z->write
+	    && json__zfile_pack(z, true)
+	    && fflush(z->fp) != 0)
+		z->err = "write failed";
+#if JSON_ZSTD
+	if (z->zstd) {
+		if (z->write)
+			ZSTD_freeCCtx(z->codec.cctx);
+		else
+			ZSTD_freeDCtx(z->codec.dctx);
+	} else
+#endif
+	if (z->write) {
+		deflateEnd(&z->codec.gz);
+	} else {
+		inflateEnd(&z->codec.gz);
+	}
+	z->done = true;
+	return z->err ? EOF : 0;
+}
+
+static const json_io_t g_json_io_zfile = {
+	.fgetc  = json__zfile_fgetc,
+	.fread  = json__zfile_fread,
+	.fwrite = json__zfile_fwrite,
+	.fputc  = json__zfile_fputc,
+	.ftell  = json__zfile_ftell,
+	.finish = json__zfile_finish,
+};
+
+static
+void json__zfile_init(json_zfile_t *z, FILE *fp, bool write, void *buf, size_t size)
+{
+	assert(size >= 2);
+	memset(z, 0, sizeof(*z)); /* also the zalloc/zfree/opaque zlib wants */
+	z->fp = fp;
+	z->write = write;
+	/* zlib counts in uInt */
+	z->size = json__min(size / 2, (size_t)1 << 30);
+	z->plain = buf;
+	z->packed = (char *)buf + z->size;
+}
+
+bool json_init_file_gz(json_t *json, json_zfile_t *z, FILE *fp, bool write, int level,
+                       void *buf, size_t size)
+{
+	json__zfile_init(z, fp, write, buf, size);
+	/* 15 window bits, +16 writes a gzip wrapper, +32 detects gzip or zlib */
+	const int ret = write ? deflateInit2(&z->codec.gz, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY)
+	                      : inflateInit2(&z->codec.gz, 15 + 32);
+	if (ret != Z_OK)
+		return false;
+	json_init(json, g_json_io_zfile, z);
+	return true;
+}
+
+#if JSON_ZSTD
+bool json_init_file_zstd(json_t *json, json_zfile_t *z, FILE *fp, bool write, int level,
+                         void *buf, size_t size)
+{
+	json__zfile_init(z, fp, write, buf, size);
+	z->zstd = true;
+	if (write) {
+		if ((z->codec.cctx = ZSTD_createCCtx()) == NULL)
+			return false;
+		/* checksummed, as gzip members are */
+		if (   ZSTD_isError(ZSTD_CCtx_setParameter(z->codec.cctx, ZSTD_c_compressionLevel, level))
+		    || ZSTD_isError(ZSTD_CCtx_setParameter(z->codec.cctx, ZSTD_c_checksumFlag, 1))) {
+			ZSTD_freeCCtx(z->codec.cctx);
+			return false;
+		}
+	} else if ((z->codec.dctx = ZSTD_createDCtx()) == NULL) {
+		return false;
+	}
+	json_init(json, g_json_io_zfile, z);
+	return true;
+}
+#endif
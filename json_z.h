@@ -0,0 +1,64 @@
+#ifndef JSON_Z_H
+#define JSON_Z_H
+
+/* Compressed file backends.  Compile json_z.c next to json.c and link with
+ * -lz; the zstd backend also needs JSON_ZSTD defined to 1 and -lzstd. */
+
+#include "json.h"
+
+#ifndef JSON_ZSTD
+#define JSON_ZSTD 0
+#endif
+
+#include <zlib.h>
+#if JSON_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Reads or writes `fp` through a streaming (de)compressor in one pass.  The
+ * caller's buffer is split in two halves, one for plain & one for compressed
+ * bytes, which together with the codec's own state bounds the memory used.
+ * `level` only matters for writing; reading accepts concatenated streams.
+ * Call json_finish in either direction: it ends the stream when writing &
+ * releases the codec.  The FILE stays open. */
+typedef struct json_zfile
+{
+	FILE *fp;
+	const char *err;      /* what failed first, or NULL */
+	/* internal */
+	bool write, zstd;
+	bool ended;           /* the last stream or frame is complete */
+	bool eof, done;
+	char *plain, *packed;
+	size_t size;          /* capacity of each half */
+	size_t pos, len;      /* position & fill of plain */
+	size_t in_pos, in_len;/* position & fill of packed when reading */
+	uint64_t offset;      /* plain bytes before the current buffer */
+	union
+	{
+		z_stream gz;
+#if JSON_ZSTD
+		ZSTD_CCtx *cctx;
+		ZSTD_DCtx *dctx;
+#endif
+	} codec;
+} json_zfile_t;
+
+/* gzip, or on reading also zlib, at zlib `level` (Z_DEFAULT_COMPRESSION, 0-9). */
+bool json_init_file_gz(json_t *json, json_zfile_t *z, FILE *fp, bool write, int level,
+                       void *buf, size_t size);
+#if JSON_ZSTD
+/* zstd frames at `level` (0 for the library default). */
+bool json_init_file_zstd(json_t *json, json_zfile_t *z, FILE *fp, bool write, int level,
+                         void *buf, size_t size);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_Z_H
@@ -0,0 +1,56 @@
+#include "json.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Re-lays out a JSON document without parsing it into anything:
+ *
+ *   transcode [-m | -p] [in [out]]
+ *
+ * -m strips all whitespace (the default), -p indents it the way the library
+ * does with JSON_PRETTY_PRINT.  Reads stdin & writes stdout when no paths are
+ * given. */
+
+static
+int usage(void)
+{
+	fprintf(stderr, "usage: transcode [-m | -p] [in [out]]\n");
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	static char buf[1 << 16];
+	FILE *in = stdin, *out = stdout;
+	bool pretty = false;
+	json_t src, dst;
+	int i = 1;
+
+	if (i < argc && argv[i][0] == '-' && argv[i][1] != 0) {
+		if (strcmp(argv[i], "-p") == 0)
+			pretty = true;
+		else if (strcmp(argv[i], "-m") != 0)
+			return usage();
+		++i;
+	}
+	if (argc - i > 2)
+		return usage();
+	if (i < argc && (in = fopen(argv[i], "rb")) == NULL) {
+		perror(argv[i]);
+		return 1;
+	}
+	if (i + 1 < argc && (out = fopen(argv[i + 1], "wb")) == NULL) {
+		perror(argv[i + 1]);
+		return 1;
+	}
+	setvbuf(out, buf, _IOFBF, sizeof(buf));
+
+	json_init_file(&src, in);
+	json_init_file(&dst, out);
+	if (!json_transcode(&dst, &src, pretty) || !json_finish(&dst)) {
+		fprintf(stderr, "transcode: %s\n", ferror(in) || ferror(out) ? "I/O error" : "malformed input");
+		return 1;
+	}
+	if (pretty)
+		fputc('\n', out);
+	return fclose(out) == 0 ? 0 : 1;
+}